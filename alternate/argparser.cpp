@@ -11,6 +11,7 @@ static inline void print_help(const char *name) {
     printf("   -l : generate light mode.\n");
     printf("   -h : print this help.\n");
     printf("   -v : print version.\n");
+    printf("   --seed <n> : seed of the hue jitter, derived from the image by default.\n");
 }
 
 Args init_args(int argc, char **argv) {
@@ -36,6 +37,25 @@ Args init_args(int argc, char **argv) {
                 case 'l':
                     a.light_mode = true;
                     break;
+                case '-': {
+                    const char *value = NULL;
+                    if (strncmp(current, "--seed=", 7) == 0) value = current + 7;
+                    else if (strcmp(current, "--seed") == 0 && i + 1 < argc) value = argv[++i];
+                    if (!value) {
+                        fprintf(stderr, "ERROR: Unknown flags `%s`!\n", current);
+                        a.exit = true;
+                        break;
+                    }
+                    char *end;
+                    a.seed = strtoull(value, &end, 0);
+                    if (end == value || *end != '\0') {
+                        fprintf(stderr, "ERROR: Invalid seed `%s`!\n", value);
+                        a.exit = true;
+                        break;
+                    }
+                    a.has_seed = true;
+                    break;
+                }
                 default:
                     fprintf(stderr, "ERROR: Unknown flags `%s`!\n", current);
                     a.exit = true;
@@ -2,6 +2,7 @@
 #define ARGPARSER_H
 
 #include "stdbool.h"
+#include "stdint.h"
 
 typedef struct {
     char *infile;
@@ -9,6 +10,9 @@ typedef struct {
     bool exit;
     bool colorful_mode;
     bool light_mode;
+    // Seed of the hue jitter, from the image content unless given.
+    bool has_seed;
+    uint64_t seed;
 } Args;
 
 Args init_args(int argc, char **argv);
@@ -1,27 +1,21 @@
 #ifndef HELPER_H
 #define HELPER_H
 
+#include <stddef.h>
 #include <stdint.h>
 
-typedef uint32_t rgb_t;
-
-typedef struct  {
-    float h, s, v;
-} hsv_t;
-
-typedef enum {
-    RED,
-    GREEN,
-    BLUE,
-    CYAN,
-    MAGENTA,
-    ORANGE,
-    SHADE
-} color_e;
+#include "../src/color.h"
 
 hsv_t rgb_to_hsv(rgb_t rgb);
 rgb_t hsv_to_rgb(hsv_t hsv);
+
+// Batch versions over structure-of-arrays HSV, vectorized with the SIMD
+// level picked by cpu.h and bit-identical to the scalar ones.
+void rgb_to_hsv_n(const rgb_t *rgb, float *h, float *s, float *v, size_t count);
+void hsv_to_rgb_n(const float *h, const float *s, const float *v, rgb_t *rgb, size_t count);
+void rgb_to_oklab_n(const rgb_t *rgb, float *L, float *a, float *b, size_t count);
 color_e tell_color(hsv_t hsv);
+void tell_color_n(const float *h, uint8_t *out, size_t count);
 void color_enum_to_mapping(color_e color, uint8_t *a, uint8_t *b);
 color_e mapping_to_color_enum(uint8_t a);
 float get_base_hue(color_e color);
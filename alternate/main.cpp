@@ -3,7 +3,6 @@
 #include <stdio.h>
 #include <errno.h>
 #include <string.h>
-#include <time.h>
 #include <algorithm>
 #include <math.h>
 #include <unordered_map>
@@ -15,6 +14,7 @@
 
 struct ColorData {
     hsv_t hsv;
+    oklab_t lab;
     uint32_t frequency;
 };
 
@@ -27,6 +27,22 @@ bool is_hue_different_enough(hsv_t new_hsv, hsv_t* selected_hsvs, int selected_c
     return true;
 }
 
+// Least OKLab distance between picked colors. This engine keeps its own
+// thresholds (see process_image) and picks six colors where the C engine
+// picks two accents, so they are kept a little further apart than its
+// second_color_oklab_diff (0.1) to stay distinct from each other.
+static const float min_color_oklab_diff = 0.12f;
+
+// Same idea for picked colors, by their perceptual distance in OKLab.
+bool is_color_different_enough(oklab_t new_lab, oklab_t* selected_labs, int selected_count) {
+    for (int i = 0; i < selected_count; i++) {
+        if (color_oklab_distance2(new_lab, selected_labs[i]) < min_color_oklab_diff * min_color_oklab_diff) {
+            return false;
+        }
+    }
+    return true;
+}
+
 void process_image(uint8_t* image, int w, int h, int n, Args *args, rgb_t *palette, hsv_t *accent) {
     static const int target_sel_count = 6;
     rgb_t most_used_colors[target_sel_count] = {};
@@ -38,6 +54,7 @@ void process_image(uint8_t* image, int w, int h, int n, Args *args, rgb_t *palet
     float saturation_avg = 0.0f;
 
     std::unordered_map<rgb_t, ColorData> color_map;
+    std::vector<rgb_t> first_seen;
 
     for (int y = 0; y < h; y += 2) {
         for (int x = 0; x < w; x+= 2) {
@@ -52,18 +69,29 @@ void process_image(uint8_t* image, int w, int h, int n, Args *args, rgb_t *palet
             if (it != color_map.end()) {
                 it->second.frequency++;
             } else {
-                hsv_t hsv = rgb_to_hsv(pixel);
-
-                value_avg += hsv.v;
-                saturation_avg += hsv.s;
-                // if (darkest_value > hsv.v) darkest_value = hsv.v;
-                // if (bright_value < hsv.v) bright_value = hsv.v;
-
-                color_map[pixel] = {hsv, 1};
+                color_map[pixel] = {{}, {}, 1};
+                first_seen.push_back(pixel);
             }
         }
     }
 
+    // Convert every distinct color in one vectorized sweep, the averages
+    // are still summed in the order the colors were first seen.
+    std::vector<float> hues(first_seen.size()), sats(first_seen.size()), vals(first_seen.size());
+    rgb_to_hsv_n(first_seen.data(), hues.data(), sats.data(), vals.data(), first_seen.size());
+    std::vector<float> ls(first_seen.size()), as(first_seen.size()), bs(first_seen.size());
+    rgb_to_oklab_n(first_seen.data(), ls.data(), as.data(), bs.data(), first_seen.size());
+    for (size_t i = 0; i < first_seen.size(); i++) {
+        value_avg += vals[i];
+        saturation_avg += sats[i];
+        // if (darkest_value > vals[i]) darkest_value = vals[i];
+        // if (bright_value < vals[i]) bright_value = vals[i];
+
+        ColorData &data = color_map[first_seen[i]];
+        data.hsv = hsv_t { hues[i], sats[i], vals[i] };
+        data.lab = oklab_t { ls[i], as[i], bs[i] };
+    }
+
     std::vector<std::pair<rgb_t, ColorData>> color_vec;
     color_vec.reserve(color_map.size());
 
@@ -85,6 +113,7 @@ void process_image(uint8_t* image, int w, int h, int n, Args *args, rgb_t *palet
     }
 
     hsv_t selected_hsvs[target_sel_count] = {};
+    oklab_t selected_labs[target_sel_count] = {};
     int selected_count = 0;
     bool found_accent = false;
 
@@ -126,11 +155,12 @@ void process_image(uint8_t* image, int w, int h, int n, Args *args, rgb_t *palet
             (data.hsv.s >= std::max(saturation_avg, 0.2f) && data.hsv.s <= 0.78);
         // if (args->colorful_mode) requirement = (data.hsv.v >= (value_avg / 1.2f) && data.hsv.s >= (saturation_avg / 1.7f));
 
-        if (is_hue_different_enough(data.hsv, selected_hsvs, selected_count) && requirement)
+        if (is_color_different_enough(data.lab, selected_labs, selected_count) && requirement)
         {
             most_used_colors[selected_count] = color;
             // most_used_freqs[selected_count] = data.frequency;
             selected_hsvs[selected_count] = data.hsv;
+            selected_labs[selected_count] = data.lab;
             selected_count++;
         }
     }
@@ -273,9 +303,9 @@ void process_image(uint8_t* image, int w, int h, int n, Args *args, rgb_t *palet
         }
     }
 
+    // Small enough for the float product below to keep its fraction.
     static float golden_ratio_conj = 0.6180339887f;
-    srand(time(NULL));
-    int jitter_seed = rand();
+    int jitter_seed = (int)(args->seed % 65536);
 
     for (int i = 0; i < 16; i++) {
         if (palette[i] > 0x0) continue;
@@ -322,6 +352,16 @@ void process_image(uint8_t* image, int w, int h, int n, Args *args, rgb_t *palet
     // }
 }
 
+// FNV-1a of the decoded pixels, the same image always gets the same seed.
+static uint64_t content_seed(const uint8_t *image, size_t size) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= image[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
 int main(int argc, char **argv) {
     Args a = init_args(argc, argv);
     if (a.exit) return 0;
@@ -351,6 +391,7 @@ int main(int argc, char **argv) {
         return 1;
     }
     fclose(input);
+    if (!a.has_seed) a.seed = content_seed(image, (size_t)w * h * 4);
 
     hsv_t accent = {};
     rgb_t *palette = (rgb_t *)calloc(18, sizeof(rgb_t));
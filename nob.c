@@ -10,15 +10,37 @@ enum BuildType {
     RELEASE
 };
 
+/* src/color_lut_table.h is generated from config.h, redo it whenever
+ * config.h or the code the generator runs changes. */
+bool build_color_lut(Cmd *cmd) {
+    static const char *out = PREFIX"color_lut_table.h";
+    static const char *gen = "tools/gen_color_lut";
+    const char *inputs[] = {
+        "tools/gen_color_lut.c", PREFIX"config.h", PREFIX"helper.c", PREFIX"helper.h", PREFIX"color.h", PREFIX"cpu.h", PREFIX"color_lut.h"
+    };
+    if (!nob_needs_rebuild(out, inputs, NOB_ARRAY_LEN(inputs))) return true;
+
+    nob_cc(cmd);
+    nob_cc_flags(cmd);
+    nob_cc_output(cmd, gen);
+    nob_cc_inputs(cmd, "tools/gen_color_lut.c", PREFIX"helper.c");
+    cmd_append(cmd, "-lm", "-lpthread");
+    if (!nob_cmd_run_sync_and_reset(cmd)) return false;
+
+    cmd_append(cmd, "./tools/gen_color_lut", out);
+    return nob_cmd_run_sync_and_reset(cmd);
+}
+
 int main(int argc, char **argv) {
     NOB_GO_REBUILD_URSELF(argc, argv);
     Cmd cmd = {0};
     enum BuildType bt = RELEASE;
 
+    if (!build_color_lut(&cmd)) return 1;
+
     nob_cc(&cmd);
     nob_cc_flags(&cmd);
     nob_cc_output(&cmd, "tmg-wall");
-    cmd_append(&cmd, "-lm");
     switch (bt) {
         case DEBUG:
             cmd_append(&cmd, "-ggdb");
@@ -29,7 +51,14 @@ int main(int argc, char **argv) {
         default:
             break;
     }
-    nob_cc_inputs(&cmd, PREFIX"main.c", PREFIX"helper.c");
+    nob_cc_inputs(&cmd, PREFIX"main.c", PREFIX"helper.c", PREFIX"histogram.c", PREFIX"parallel.c",
+                  PREFIX"decoder.c", PREFIX"decoder_libjpeg.c", PREFIX"decoder_libpng.c", PREFIX"exif.c", PREFIX"filter.c",
+                  PREFIX"color_lut.c", PREFIX"selftest.c",
+                  PREFIX"engine.c", PREFIX"engine_frequency.c", PREFIX"engine_kmeans.c",
+                  PREFIX"engine_median_cut.c", PREFIX"engine_octree.c",
+                  PREFIX"engine_wu.c", PREFIX"engine_hsv.c", PREFIX"engine_hue_peak.c",
+                  PREFIX"candidates.c", PREFIX"hsv_histogram.c", PREFIX"contrast.c");
+    cmd_append(&cmd, "-lm", "-lpthread");
 
     if (!nob_cmd_run_sync_and_reset(&cmd)) return 1;
 
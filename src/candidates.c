@@ -0,0 +1,119 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "candidates.h"
+
+/* "a wins over b": more pixels, then lower rgb. */
+static bool beats(const candidate_t *a, const candidate_t *b) {
+    return !b || a->count > b->count || (a->count == b->count && a->rgb < b->rgb);
+}
+
+static void swap(candidate_t *a, candidate_t *b) {
+    candidate_t tmp = *a;
+    *a = *b;
+    *b = tmp;
+}
+
+/* The heap keeps the weakest candidate of a bucket on top. */
+static void heap_down(candidate_bin_t *bin, uint32_t i) {
+    for (;;) {
+        uint32_t l = i * 2 + 1, r = l + 1, m = i;
+        if (l < bin->size && beats(&bin->top[m], &bin->top[l])) m = l;
+        if (r < bin->size && beats(&bin->top[m], &bin->top[r])) m = r;
+        if (m == i) return;
+        swap(&bin->top[i], &bin->top[m]);
+        i = m;
+    }
+}
+
+static void heap_up(candidate_bin_t *bin, uint32_t i) {
+    while (i > 0 && beats(&bin->top[(i - 1) / 2], &bin->top[i])) {
+        swap(&bin->top[i], &bin->top[(i - 1) / 2]);
+        i = (i - 1) / 2;
+    }
+}
+
+bool candidate_index_init(candidate_index_t *index) {
+    memset(index, 0, sizeof(*index));
+    index->bins = calloc(CANDIDATE_HUE_BINS, sizeof(candidate_bin_t));
+    return index->bins != NULL;
+}
+
+void candidate_index_add(candidate_index_t *index, uint16_t bin_index, candidate_t candidate) {
+    candidate_bin_t *bin = &index->bins[bin_index];
+    if (bin->size < CANDIDATE_BIN_TOP) {
+        bin->top[bin->size++] = candidate;
+        heap_up(bin, bin->size - 1);
+        return;
+    }
+
+    /* Whatever is let go loses to everything kept, now and later. */
+    uint32_t dropped = candidate.count;
+    if (beats(&candidate, &bin->top[0])) {
+        dropped = bin->top[0].count;
+        bin->top[0] = candidate;
+        heap_down(bin, 0);
+    }
+    if (dropped > bin->dropped) bin->dropped = dropped;
+}
+
+static int compare_candidates(const void *a, const void *b) {
+    const candidate_t *x = a, *y = b;
+    if (x->count != y->count) return x->count > y->count ? -1 : 1;
+    return (x->rgb > y->rgb) - (x->rgb < y->rgb);
+}
+
+typedef struct {
+    uint32_t count;
+    uint16_t bin;
+} bin_top_t;
+
+static int compare_bins(const void *a, const void *b) {
+    const bin_top_t *x = a, *y = b;
+    if (x->count != y->count) return x->count > y->count ? -1 : 1;
+    return (x->bin > y->bin) - (x->bin < y->bin);
+}
+
+void candidate_index_finish(candidate_index_t *index) {
+    /* Empty buckets have a count of 0 and sort last. */
+    bin_top_t tops[CANDIDATE_HUE_BINS];
+    for (int b = 0; b < CANDIDATE_HUE_BINS; b++) {
+        candidate_bin_t *bin = &index->bins[b];
+        if (bin->size > 0) qsort(bin->top, bin->size, sizeof(candidate_t), compare_candidates);
+        tops[b] = (bin_top_t){ bin->size ? bin->top[0].count : 0, b };
+    }
+    qsort(tops, CANDIDATE_HUE_BINS, sizeof(bin_top_t), compare_bins);
+    for (int o = 0; o < CANDIDATE_HUE_BINS; o++) index->order[o] = tops[o].bin;
+}
+
+void candidate_index_free(candidate_index_t *index) {
+    free(index->bins);
+    memset(index, 0, sizeof(*index));
+}
+
+bool candidate_index_query(const candidate_index_t *index, uint32_t below, oklab_t avoid, float min_dist2,
+                           const candidate_t **out) {
+    const candidate_t *best = NULL;
+    for (int o = 0; o < CANDIDATE_HUE_BINS; o++) {
+        const candidate_bin_t *bin = &index->bins[index->order[o]];
+        if (bin->size == 0) break;
+        /* Buckets further down have no more used candidate than this one. */
+        if (best && bin->top[0].count < best->count) break;
+
+        bool settled = false;
+        for (uint32_t i = 0; i < bin->size && !settled; i++) {
+            const candidate_t *c = &bin->top[i];
+            if (c->count >= below) continue;
+            if (best && !beats(c, best)) {
+                settled = true;
+            } else if (color_oklab_distance2(c->lab, avoid) >= min_dist2) {
+                best = c;
+                settled = true;
+            }
+        }
+        /* One the bucket let go may have been the answer. */
+        if (!settled && bin->dropped && (!best || bin->dropped >= best->count)) return false;
+    }
+    *out = best;
+    return true;
+}
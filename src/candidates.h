@@ -0,0 +1,62 @@
+#ifndef CANDIDATES_H
+#define CANDIDATES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "helper.h"
+
+/* The colors that passed the accent filters, bucketed by hue, for the
+ * second accent. Each bucket keeps only its CANDIDATE_BIN_TOP most used
+ * candidates (a min-heap while they come in) and the count of the most
+ * used one it let go, so the index is a fixed 230 KB whatever the number
+ * of colors. A query walks the buckets from the one with the most used
+ * candidate down and stops as soon as a bucket can not beat what it
+ * already has, so it usually reads a handful of candidates. Its answer is
+ * the one a scan of every candidate would give, unless that needed one a
+ * bucket let go: the query then says so and the caller scans again. */
+
+#define CANDIDATE_HUE_BINS 360
+#define CANDIDATE_BIN_TOP  32
+
+typedef struct {
+    rgb_t rgb;
+    uint32_t count;
+    oklab_t lab;
+} candidate_t;
+
+typedef struct {
+    /* Most used first once finished. */
+    candidate_t top[CANDIDATE_BIN_TOP];
+    uint32_t size;
+    uint32_t dropped; /* 0 when none was let go */
+} candidate_bin_t;
+
+typedef struct {
+    candidate_bin_t *bins;
+    /* Buckets in decreasing order of their most used candidate. */
+    uint16_t order[CANDIDATE_HUE_BINS];
+} candidate_index_t;
+
+/* False when out of memory. */
+bool candidate_index_init(candidate_index_t *index);
+/* `bin` from the hue in turns with candidate_bin(). */
+void candidate_index_add(candidate_index_t *index, uint16_t bin, candidate_t candidate);
+/* Once every candidate was added, before any query. */
+void candidate_index_finish(candidate_index_t *index);
+void candidate_index_free(candidate_index_t *index);
+
+static inline uint16_t candidate_bin(float hue) {
+    int bin = (int)(hue * CANDIDATE_HUE_BINS);
+    return bin < 0 ? 0 : bin >= CANDIDATE_HUE_BINS ? CANDIDATE_HUE_BINS - 1 : bin;
+}
+
+/* The most used candidate used by fewer than `below` pixels and at least
+ * sqrt(min_dist2) away in OKLab from `avoid`, ties going to the lower rgb,
+ * into `*out` (NULL if there is none). False when the candidates kept can
+ * not tell, `*out` is then unset. */
+bool candidate_index_query(const candidate_index_t *index, uint32_t below, oklab_t avoid, float min_dist2,
+                           const candidate_t **out);
+
+#endif /* CANDIDATES_H */
@@ -0,0 +1,1033 @@
+#ifndef COLOR_H
+#define COLOR_H
+
+/* Color space core shared by both engines: the C one includes it from
+ * src/helper.h, the C++ one from alternate/helper.h. Header only, valid C
+ * and C++; in C++ the scalar functions are constexpr and the `color::`
+ * templates at the bottom pick the precision and hue unit at compile time.
+ *
+ * Hue is either in turns [0, 1) (the C engine) or degrees [0, 360) (the
+ * C++ engine). Both units run the very same operations except for the
+ * sector scaling, so each engine keeps its exact historical results. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "cpu.h"
+
+#if defined(__x86_64__)
+#define COLOR_X86
+#include <immintrin.h>
+#endif
+
+/* The vector kernels only match the scalar code if no multiply-add gets
+ * fused, which GCC would otherwise do wherever FMA is available: inside
+ * the AVX-512 kernels, or everywhere with -march=native. */
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC push_options
+#pragma GCC optimize("fp-contract=off")
+/* GCC 12 flags its own _mm512_undefined_* placeholders when inlined. */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+#ifdef __cplusplus
+#define COLOR_FN static inline constexpr
+#else
+#define COLOR_FN static inline
+#endif
+
+typedef uint32_t rgb_t;
+
+typedef struct {
+    float h, s, v;
+} hsv_t;
+
+typedef struct {
+    double h, s, v;
+} hsvd_t;
+
+typedef enum {
+    RED,
+    GREEN,
+    BLUE,
+    CYAN,
+    MAGENTA,
+    ORANGE,
+    SHADE
+} color_e;
+
+typedef enum {
+    HUE_TURNS,
+    HUE_DEGREES,
+} hue_unit_e;
+
+/* -- Base16 slots -- */
+
+/* The bright and dark base16 slot of each hue class, SHADE has none. */
+COLOR_FN int color_slot_bright(color_e color) {
+    switch (color) {
+    case RED:     return 12;
+    case GREEN:   return 10;
+    case BLUE:    return 9;
+    case CYAN:    return 11;
+    case MAGENTA: return 13;
+    case ORANGE:  return 14;
+    default:      return -1;
+    }
+}
+
+COLOR_FN int color_slot_dark(color_e color) {
+    int bright = color_slot_bright(color);
+    return bright < 0 ? -1 : bright - 8;
+}
+
+COLOR_FN color_e color_from_slot(int slot) {
+    switch (slot) {
+    case 12: case 4: return RED;
+    case 10: case 2: return GREEN;
+    case 9:  case 1: return BLUE;
+    case 11: case 3: return CYAN;
+    case 13: case 5: return MAGENTA;
+    case 14: case 6: return ORANGE;
+    default:         return SHADE;
+    }
+}
+
+/* Hue the generated slot colors are built around, in degrees. */
+COLOR_FN double color_base_hue_degrees(color_e color) {
+    switch (color) {
+    case ORANGE:  return 45.0;
+    case GREEN:   return 112.5;
+    case CYAN:    return 180.0;
+    case BLUE:    return 240.0;
+    case MAGENTA: return 300.0;
+    default:      return 0.0;
+    }
+}
+
+/* -- Scalar conversions -- */
+
+/* The body is stamped once per precision. `fmod` is done by subtracting
+ * halving multiples of the full turn, which is exact (every step is a
+ * Sterbenz subtraction), so it matches fmodf bit for bit while staying
+ * usable in constant expressions. NaN and infinite hues give 0. */
+#define COLOR_DEFINE_PRECISION(T, HSV, SUFFIX)                                          \
+    COLOR_FN T color_hue_full_##SUFFIX(hue_unit_e unit) {                               \
+        return unit == HUE_TURNS ? (T)1 : (T)360;                                       \
+    }                                                                                   \
+                                                                                        \
+    COLOR_FN T color_base_hue_##SUFFIX(color_e color, hue_unit_e unit) {                \
+        T deg = (T)color_base_hue_degrees(color);                                       \
+        return unit == HUE_TURNS ? deg / (T)360 : deg;                                  \
+    }                                                                                   \
+                                                                                        \
+    COLOR_FN T color_clamp_##SUFFIX(T x, T lo, T hi) {                                  \
+        return (x < lo) ? lo : (hi < x) ? hi : x;                                       \
+    }                                                                                   \
+                                                                                        \
+    COLOR_FN T color_wrap_hue_##SUFFIX(T h, hue_unit_e unit) {                          \
+        T full = color_hue_full_##SUFFIX(unit);                                         \
+        if (h != h || h - h != 0) return 0;                                             \
+        T a = h < 0 ? -h : h;                                                           \
+        T m = full;                                                                     \
+        while (m * 2 <= a) m *= 2;                                                      \
+        while (a >= full) {                                                             \
+            if (a >= m) a -= m;                                                         \
+            m /= 2;                                                                     \
+        }                                                                               \
+        T out = h < 0 ? -a : a;                                                         \
+        if (out < 0) out += full;                                                       \
+        return out;                                                                     \
+    }                                                                                   \
+                                                                                        \
+    COLOR_FN HSV color_rgb_to_hsv_##SUFFIX(rgb_t rgb, hue_unit_e unit) {                \
+        T r = ((rgb >> 16) & 0xFF) / (T)255;                                            \
+        T g = ((rgb >> 8)  & 0xFF) / (T)255;                                            \
+        T b = ( rgb        & 0xFF) / (T)255;                                            \
+                                                                                        \
+        T max = (r > g) ? ((r > b) ? r : b) : ((g > b) ? g : b);                        \
+        T min = (r < g) ? ((r < b) ? r : b) : ((g < b) ? g : b);                        \
+        T delta = max - min;                                                            \
+                                                                                        \
+        HSV out = { 0, 0, 0 };                                                          \
+        out.v = max;                                                                    \
+        out.s = (max == 0) ? (T)0 : (delta / max);                                      \
+                                                                                        \
+        /* Sector position in [-1, 5), 0 when the hue is undefined. */                  \
+        T sector = 0;                                                                   \
+        if (delta == 0) {                                                               \
+            sector = 0;                                                                 \
+        } else if (max == r) {                                                          \
+            sector = (g - b) / delta;                                                   \
+        } else if (max == g) {                                                          \
+            sector = (b - r) / delta + (T)2;                                            \
+        } else {                                                                        \
+            sector = (r - g) / delta + (T)4;                                            \
+        }                                                                               \
+                                                                                        \
+        out.h = unit == HUE_TURNS ? sector / (T)6 : (T)60 * sector;                     \
+        out.h = color_wrap_hue_##SUFFIX(out.h, unit);                                   \
+        out.s = color_clamp_##SUFFIX(out.s, 0, 1);                                      \
+        out.v = color_clamp_##SUFFIX(out.v, 0, 1);                                      \
+        return out;                                                                     \
+    }                                                                                   \
+                                                                                        \
+    COLOR_FN rgb_t color_hsv_to_rgb_##SUFFIX(HSV hsv, hue_unit_e unit) {                \
+        T h = color_wrap_hue_##SUFFIX(hsv.h, unit);                                     \
+        T s = color_clamp_##SUFFIX(hsv.s, 0, 1);                                        \
+        T v = color_clamp_##SUFFIX(hsv.v, 0, 1);                                        \
+                                                                                        \
+        T r = v, g = v, b = v;                                                          \
+        if (s > 0) {                                                                    \
+            T hh = unit == HUE_TURNS ? h * (T)6 : h / (T)60;                            \
+            int i = (int)hh;                                                            \
+            T f = hh - i;                                                               \
+            T p = v * ((T)1 - s);                                                       \
+            T q = v * ((T)1 - s * f);                                                   \
+            T t = v * ((T)1 - s * ((T)1 - f));                                          \
+                                                                                        \
+            switch (i % 6) {                                                            \
+            case 0: r = v; g = t; b = p; break;                                         \
+            case 1: r = q; g = v; b = p; break;                                         \
+            case 2: r = p; g = v; b = t; break;                                         \
+            case 3: r = p; g = q; b = v; break;                                         \
+            case 4: r = t; g = p; b = v; break;                                         \
+            default: r = v; g = p; b = q; break;                                        \
+            }                                                                           \
+        }                                                                               \
+                                                                                        \
+        uint8_t R = (uint8_t)(r * (T)255 + (T)0.5);                                     \
+        uint8_t G = (uint8_t)(g * (T)255 + (T)0.5);                                     \
+        uint8_t B = (uint8_t)(b * (T)255 + (T)0.5);                                     \
+        return ((rgb_t)R << 16) | ((rgb_t)G << 8) | B;                                  \
+    }
+
+COLOR_DEFINE_PRECISION(float, hsv_t, f)
+COLOR_DEFINE_PRECISION(double, hsvd_t, d)
+
+/* -- Batch conversions -- */
+
+/* Structure-of-arrays float versions, vectorized with SSE4.1, AVX2 or
+ * AVX-512 as cpu.h allows. The kernels do the scalar operations above in
+ * the same order and without FMA, with blends in place of the branches,
+ * so results are bit-identical. rgb -> hsv never needs the hue wrap;
+ * hsv -> rgb only takes lanes whose hue is already in [0, full) and hands
+ * the rest to the scalar code. */
+
+static inline void color_rgb_to_hsv_n_scalar(const rgb_t *rgb, float *h, float *s, float *v,
+                                             size_t count, hue_unit_e unit) {
+    for (size_t i = 0; i < count; i++) {
+        hsv_t out = color_rgb_to_hsv_f(rgb[i], unit);
+        h[i] = out.h;
+        s[i] = out.s;
+        v[i] = out.v;
+    }
+}
+
+static inline void color_hsv_to_rgb_n_scalar(const float *h, const float *s, const float *v, rgb_t *rgb,
+                                             size_t count, hue_unit_e unit) {
+    for (size_t i = 0; i < count; i++) {
+        hsv_t in = { h[i], s[i], v[i] };
+        rgb[i] = color_hsv_to_rgb_f(in, unit);
+    }
+}
+
+#ifdef COLOR_X86
+__attribute__((target("sse4.1"), unused))
+static void color_rgb_to_hsv_n_sse41(const rgb_t *rgb, float *h, float *s, float *v,
+                                     size_t count, hue_unit_e unit) {
+    const __m128i mask = _mm_set1_epi32(0xFF);
+    const __m128 k255 = _mm_set1_ps(255.0f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 two  = _mm_set1_ps(2.0f);
+    const __m128 four = _mm_set1_ps(4.0f);
+    const __m128 six  = _mm_set1_ps(6.0f);
+    const __m128 k60  = _mm_set1_ps(60.0f);
+    const __m128 full = _mm_set1_ps(color_hue_full_f(unit));
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i px = _mm_loadu_si128((const __m128i *)(rgb + i));
+        __m128 r = _mm_div_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(px, 16), mask)), k255);
+        __m128 g = _mm_div_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(px, 8), mask)), k255);
+        __m128 b = _mm_div_ps(_mm_cvtepi32_ps(_mm_and_si128(px, mask)), k255);
+
+        __m128 max = _mm_max_ps(_mm_max_ps(r, g), b);
+        __m128 min = _mm_min_ps(_mm_min_ps(r, g), b);
+        __m128 delta = _mm_sub_ps(max, min);
+
+        __m128 sat = _mm_blendv_ps(_mm_div_ps(delta, max), zero, _mm_cmpeq_ps(max, zero));
+
+        __m128 is_r = _mm_cmpeq_ps(max, r);
+        __m128 is_g = _mm_andnot_ps(is_r, _mm_cmpeq_ps(max, g));
+        __m128 num = _mm_sub_ps(r, g);
+        num = _mm_blendv_ps(num, _mm_sub_ps(b, r), is_g);
+        num = _mm_blendv_ps(num, _mm_sub_ps(g, b), is_r);
+        __m128 sector = _mm_div_ps(num, delta);
+        sector = _mm_blendv_ps(_mm_add_ps(sector, _mm_blendv_ps(four, two, is_g)), sector, is_r);
+        sector = _mm_blendv_ps(sector, zero, _mm_cmpeq_ps(delta, zero));
+        __m128 hue = unit == HUE_TURNS ? _mm_div_ps(sector, six) : _mm_mul_ps(k60, sector);
+        hue = _mm_blendv_ps(hue, _mm_add_ps(hue, full), _mm_cmplt_ps(hue, zero));
+
+        _mm_storeu_ps(h + i, hue);
+        _mm_storeu_ps(s + i, sat);
+        _mm_storeu_ps(v + i, max);
+    }
+    color_rgb_to_hsv_n_scalar(rgb + i, h + i, s + i, v + i, count - i, unit);
+}
+
+__attribute__((target("sse4.1"), unused))
+static void color_hsv_to_rgb_n_sse41(const float *h, const float *s, const float *v, rgb_t *rgb,
+                                     size_t count, hue_unit_e unit) {
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one  = _mm_set1_ps(1.0f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 six  = _mm_set1_ps(6.0f);
+    const __m128 k60  = _mm_set1_ps(60.0f);
+    const __m128 k255 = _mm_set1_ps(255.0f);
+    const __m128 full = _mm_set1_ps(color_hue_full_f(unit));
+    const __m128i mask = _mm_set1_epi32(0xFF);
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 hh = _mm_loadu_ps(h + i);
+        __m128 in_range = _mm_and_ps(_mm_cmpge_ps(hh, zero), _mm_cmplt_ps(hh, full));
+        if (_mm_movemask_ps(in_range) != 0xF) {
+            color_hsv_to_rgb_n_scalar(h + i, s + i, v + i, rgb + i, 4, unit);
+            continue;
+        }
+
+        /* color_clamp: x < 0 ? 0 : 1 < x ? 1 : x */
+        __m128 ss = _mm_loadu_ps(s + i);
+        ss = _mm_blendv_ps(_mm_blendv_ps(ss, one, _mm_cmplt_ps(one, ss)), zero, _mm_cmplt_ps(ss, zero));
+        __m128 vv = _mm_loadu_ps(v + i);
+        vv = _mm_blendv_ps(_mm_blendv_ps(vv, one, _mm_cmplt_ps(one, vv)), zero, _mm_cmplt_ps(vv, zero));
+
+        __m128 h6 = unit == HUE_TURNS ? _mm_mul_ps(hh, six) : _mm_div_ps(hh, k60);
+        __m128i sector = _mm_cvttps_epi32(h6);
+        __m128 fi = _mm_cvtepi32_ps(sector);
+        __m128 f = _mm_sub_ps(h6, fi);
+        __m128 p = _mm_mul_ps(vv, _mm_sub_ps(one, ss));
+        __m128 q = _mm_mul_ps(vv, _mm_sub_ps(one, _mm_mul_ps(ss, f)));
+        __m128 t = _mm_mul_ps(vv, _mm_sub_ps(one, _mm_mul_ps(ss, _mm_sub_ps(one, f))));
+
+        /* sector is 0..6, only 6 needs folding back to 0 */
+        __m128i m = _mm_and_si128(sector, _mm_cmplt_epi32(sector, _mm_set1_epi32(6)));
+        __m128 m0 = _mm_castsi128_ps(_mm_cmpeq_epi32(m, _mm_set1_epi32(0)));
+        __m128 m1 = _mm_castsi128_ps(_mm_cmpeq_epi32(m, _mm_set1_epi32(1)));
+        __m128 m2 = _mm_castsi128_ps(_mm_cmpeq_epi32(m, _mm_set1_epi32(2)));
+        __m128 m3 = _mm_castsi128_ps(_mm_cmpeq_epi32(m, _mm_set1_epi32(3)));
+        __m128 m4 = _mm_castsi128_ps(_mm_cmpeq_epi32(m, _mm_set1_epi32(4)));
+        __m128 m5 = _mm_castsi128_ps(_mm_cmpeq_epi32(m, _mm_set1_epi32(5)));
+
+        __m128 r = vv;
+        r = _mm_blendv_ps(r, q, m1);
+        r = _mm_blendv_ps(r, p, _mm_or_ps(m2, m3));
+        r = _mm_blendv_ps(r, t, m4);
+        __m128 g = p;
+        g = _mm_blendv_ps(g, t, m0);
+        g = _mm_blendv_ps(g, vv, _mm_or_ps(m1, m2));
+        g = _mm_blendv_ps(g, q, m3);
+        __m128 b = p;
+        b = _mm_blendv_ps(b, t, m2);
+        b = _mm_blendv_ps(b, vv, _mm_or_ps(m3, m4));
+        b = _mm_blendv_ps(b, q, m5);
+
+        __m128 gray = _mm_cmple_ps(ss, zero);
+        r = _mm_blendv_ps(r, vv, gray);
+        g = _mm_blendv_ps(g, vv, gray);
+        b = _mm_blendv_ps(b, vv, gray);
+
+        __m128i R = _mm_and_si128(_mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(r, k255), half)), mask);
+        __m128i G = _mm_and_si128(_mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(g, k255), half)), mask);
+        __m128i B = _mm_and_si128(_mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(b, k255), half)), mask);
+        __m128i out = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(R, 16), _mm_slli_epi32(G, 8)), B);
+        _mm_storeu_si128((__m128i *)(rgb + i), out);
+    }
+    color_hsv_to_rgb_n_scalar(h + i, s + i, v + i, rgb + i, count - i, unit);
+}
+
+__attribute__((target("avx2"), unused))
+static void color_rgb_to_hsv_n_avx2(const rgb_t *rgb, float *h, float *s, float *v,
+                                    size_t count, hue_unit_e unit) {
+    const __m256i mask = _mm256_set1_epi32(0xFF);
+    const __m256 k255 = _mm256_set1_ps(255.0f);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 two  = _mm256_set1_ps(2.0f);
+    const __m256 four = _mm256_set1_ps(4.0f);
+    const __m256 six  = _mm256_set1_ps(6.0f);
+    const __m256 k60  = _mm256_set1_ps(60.0f);
+    const __m256 full = _mm256_set1_ps(color_hue_full_f(unit));
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i px = _mm256_loadu_si256((const __m256i *)(rgb + i));
+        __m256 r = _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(px, 16), mask)), k255);
+        __m256 g = _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(px, 8), mask)), k255);
+        __m256 b = _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_and_si256(px, mask)), k255);
+
+        __m256 max = _mm256_max_ps(_mm256_max_ps(r, g), b);
+        __m256 min = _mm256_min_ps(_mm256_min_ps(r, g), b);
+        __m256 delta = _mm256_sub_ps(max, min);
+
+        __m256 sat = _mm256_blendv_ps(_mm256_div_ps(delta, max), zero, _mm256_cmp_ps(max, zero, _CMP_EQ_OQ));
+
+        __m256 is_r = _mm256_cmp_ps(max, r, _CMP_EQ_OQ);
+        __m256 is_g = _mm256_andnot_ps(is_r, _mm256_cmp_ps(max, g, _CMP_EQ_OQ));
+        __m256 num = _mm256_sub_ps(r, g);
+        num = _mm256_blendv_ps(num, _mm256_sub_ps(b, r), is_g);
+        num = _mm256_blendv_ps(num, _mm256_sub_ps(g, b), is_r);
+        __m256 sector = _mm256_div_ps(num, delta);
+        sector = _mm256_blendv_ps(_mm256_add_ps(sector, _mm256_blendv_ps(four, two, is_g)), sector, is_r);
+        sector = _mm256_blendv_ps(sector, zero, _mm256_cmp_ps(delta, zero, _CMP_EQ_OQ));
+        __m256 hue = unit == HUE_TURNS ? _mm256_div_ps(sector, six) : _mm256_mul_ps(k60, sector);
+        hue = _mm256_blendv_ps(hue, _mm256_add_ps(hue, full), _mm256_cmp_ps(hue, zero, _CMP_LT_OQ));
+
+        _mm256_storeu_ps(h + i, hue);
+        _mm256_storeu_ps(s + i, sat);
+        _mm256_storeu_ps(v + i, max);
+    }
+    color_rgb_to_hsv_n_sse41(rgb + i, h + i, s + i, v + i, count - i, unit);
+}
+
+__attribute__((target("avx2"), unused))
+static void color_hsv_to_rgb_n_avx2(const float *h, const float *s, const float *v, rgb_t *rgb,
+                                    size_t count, hue_unit_e unit) {
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one  = _mm256_set1_ps(1.0f);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 six  = _mm256_set1_ps(6.0f);
+    const __m256 k60  = _mm256_set1_ps(60.0f);
+    const __m256 k255 = _mm256_set1_ps(255.0f);
+    const __m256 full = _mm256_set1_ps(color_hue_full_f(unit));
+    const __m256i mask = _mm256_set1_epi32(0xFF);
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 hh = _mm256_loadu_ps(h + i);
+        __m256 in_range = _mm256_and_ps(_mm256_cmp_ps(hh, zero, _CMP_GE_OQ), _mm256_cmp_ps(hh, full, _CMP_LT_OQ));
+        if (_mm256_movemask_ps(in_range) != 0xFF) {
+            color_hsv_to_rgb_n_scalar(h + i, s + i, v + i, rgb + i, 8, unit);
+            continue;
+        }
+
+        __m256 ss = _mm256_loadu_ps(s + i);
+        ss = _mm256_blendv_ps(_mm256_blendv_ps(ss, one, _mm256_cmp_ps(one, ss, _CMP_LT_OQ)),
+                              zero, _mm256_cmp_ps(ss, zero, _CMP_LT_OQ));
+        __m256 vv = _mm256_loadu_ps(v + i);
+        vv = _mm256_blendv_ps(_mm256_blendv_ps(vv, one, _mm256_cmp_ps(one, vv, _CMP_LT_OQ)),
+                              zero, _mm256_cmp_ps(vv, zero, _CMP_LT_OQ));
+
+        __m256 h6 = unit == HUE_TURNS ? _mm256_mul_ps(hh, six) : _mm256_div_ps(hh, k60);
+        __m256i sector = _mm256_cvttps_epi32(h6);
+        __m256 fi = _mm256_cvtepi32_ps(sector);
+        __m256 f = _mm256_sub_ps(h6, fi);
+        __m256 p = _mm256_mul_ps(vv, _mm256_sub_ps(one, ss));
+        __m256 q = _mm256_mul_ps(vv, _mm256_sub_ps(one, _mm256_mul_ps(ss, f)));
+        __m256 t = _mm256_mul_ps(vv, _mm256_sub_ps(one, _mm256_mul_ps(ss, _mm256_sub_ps(one, f))));
+
+        __m256i m = _mm256_and_si256(sector, _mm256_cmpgt_epi32(_mm256_set1_epi32(6), sector));
+        __m256 m0 = _mm256_castsi256_ps(_mm256_cmpeq_epi32(m, _mm256_set1_epi32(0)));
+        __m256 m1 = _mm256_castsi256_ps(_mm256_cmpeq_epi32(m, _mm256_set1_epi32(1)));
+        __m256 m2 = _mm256_castsi256_ps(_mm256_cmpeq_epi32(m, _mm256_set1_epi32(2)));
+        __m256 m3 = _mm256_castsi256_ps(_mm256_cmpeq_epi32(m, _mm256_set1_epi32(3)));
+        __m256 m4 = _mm256_castsi256_ps(_mm256_cmpeq_epi32(m, _mm256_set1_epi32(4)));
+        __m256 m5 = _mm256_castsi256_ps(_mm256_cmpeq_epi32(m, _mm256_set1_epi32(5)));
+
+        __m256 r = vv;
+        r = _mm256_blendv_ps(r, q, m1);
+        r = _mm256_blendv_ps(r, p, _mm256_or_ps(m2, m3));
+        r = _mm256_blendv_ps(r, t, m4);
+        __m256 g = p;
+        g = _mm256_blendv_ps(g, t, m0);
+        g = _mm256_blendv_ps(g, vv, _mm256_or_ps(m1, m2));
+        g = _mm256_blendv_ps(g, q, m3);
+        __m256 b = p;
+        b = _mm256_blendv_ps(b, t, m2);
+        b = _mm256_blendv_ps(b, vv, _mm256_or_ps(m3, m4));
+        b = _mm256_blendv_ps(b, q, m5);
+
+        __m256 gray = _mm256_cmp_ps(ss, zero, _CMP_LE_OQ);
+        r = _mm256_blendv_ps(r, vv, gray);
+        g = _mm256_blendv_ps(g, vv, gray);
+        b = _mm256_blendv_ps(b, vv, gray);
+
+        __m256i R = _mm256_and_si256(_mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(r, k255), half)), mask);
+        __m256i G = _mm256_and_si256(_mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(g, k255), half)), mask);
+        __m256i B = _mm256_and_si256(_mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(b, k255), half)), mask);
+        __m256i out = _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi32(R, 16), _mm256_slli_epi32(G, 8)), B);
+        _mm256_storeu_si256((__m256i *)(rgb + i), out);
+    }
+    color_hsv_to_rgb_n_sse41(h + i, s + i, v + i, rgb + i, count - i, unit);
+}
+
+__attribute__((target("avx512f"), unused))
+static void color_rgb_to_hsv_n_avx512(const rgb_t *rgb, float *h, float *s, float *v,
+                                      size_t count, hue_unit_e unit) {
+    const __m512i mask = _mm512_set1_epi32(0xFF);
+    const __m512 k255 = _mm512_set1_ps(255.0f);
+    const __m512 zero = _mm512_setzero_ps();
+    const __m512 two  = _mm512_set1_ps(2.0f);
+    const __m512 four = _mm512_set1_ps(4.0f);
+    const __m512 six  = _mm512_set1_ps(6.0f);
+    const __m512 k60  = _mm512_set1_ps(60.0f);
+    const __m512 full = _mm512_set1_ps(color_hue_full_f(unit));
+
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m512i px = _mm512_loadu_si512((const void *)(rgb + i));
+        __m512 r = _mm512_div_ps(_mm512_cvtepi32_ps(_mm512_and_si512(_mm512_srli_epi32(px, 16), mask)), k255);
+        __m512 g = _mm512_div_ps(_mm512_cvtepi32_ps(_mm512_and_si512(_mm512_srli_epi32(px, 8), mask)), k255);
+        __m512 b = _mm512_div_ps(_mm512_cvtepi32_ps(_mm512_and_si512(px, mask)), k255);
+
+        __m512 max = _mm512_max_ps(_mm512_max_ps(r, g), b);
+        __m512 min = _mm512_min_ps(_mm512_min_ps(r, g), b);
+        __m512 delta = _mm512_sub_ps(max, min);
+
+        __m512 sat = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(max, zero, _CMP_EQ_OQ), _mm512_div_ps(delta, max), zero);
+
+        __mmask16 is_r = _mm512_cmp_ps_mask(max, r, _CMP_EQ_OQ);
+        __mmask16 is_g = (__mmask16)(~is_r & _mm512_cmp_ps_mask(max, g, _CMP_EQ_OQ));
+        __m512 num = _mm512_sub_ps(r, g);
+        num = _mm512_mask_blend_ps(is_g, num, _mm512_sub_ps(b, r));
+        num = _mm512_mask_blend_ps(is_r, num, _mm512_sub_ps(g, b));
+        __m512 sector = _mm512_div_ps(num, delta);
+        sector = _mm512_mask_blend_ps(is_r, _mm512_add_ps(sector, _mm512_mask_blend_ps(is_g, four, two)), sector);
+        sector = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(delta, zero, _CMP_EQ_OQ), sector, zero);
+        __m512 hue = unit == HUE_TURNS ? _mm512_div_ps(sector, six) : _mm512_mul_ps(k60, sector);
+        hue = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(hue, zero, _CMP_LT_OQ), hue, _mm512_add_ps(hue, full));
+
+        _mm512_storeu_ps(h + i, hue);
+        _mm512_storeu_ps(s + i, sat);
+        _mm512_storeu_ps(v + i, max);
+    }
+    color_rgb_to_hsv_n_avx2(rgb + i, h + i, s + i, v + i, count - i, unit);
+}
+
+__attribute__((target("avx512f"), unused))
+static void color_hsv_to_rgb_n_avx512(const float *h, const float *s, const float *v, rgb_t *rgb,
+                                      size_t count, hue_unit_e unit) {
+    const __m512 zero = _mm512_setzero_ps();
+    const __m512 one  = _mm512_set1_ps(1.0f);
+    const __m512 half = _mm512_set1_ps(0.5f);
+    const __m512 six  = _mm512_set1_ps(6.0f);
+    const __m512 k60  = _mm512_set1_ps(60.0f);
+    const __m512 k255 = _mm512_set1_ps(255.0f);
+    const __m512 full = _mm512_set1_ps(color_hue_full_f(unit));
+    const __m512i mask = _mm512_set1_epi32(0xFF);
+
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m512 hh = _mm512_loadu_ps(h + i);
+        __mmask16 in_range = _mm512_cmp_ps_mask(hh, zero, _CMP_GE_OQ) & _mm512_cmp_ps_mask(hh, full, _CMP_LT_OQ);
+        if (in_range != 0xFFFF) {
+            color_hsv_to_rgb_n_scalar(h + i, s + i, v + i, rgb + i, 16, unit);
+            continue;
+        }
+
+        __m512 ss = _mm512_loadu_ps(s + i);
+        ss = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(ss, zero, _CMP_LT_OQ),
+                                  _mm512_mask_blend_ps(_mm512_cmp_ps_mask(one, ss, _CMP_LT_OQ), ss, one), zero);
+        __m512 vv = _mm512_loadu_ps(v + i);
+        vv = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(vv, zero, _CMP_LT_OQ),
+                                  _mm512_mask_blend_ps(_mm512_cmp_ps_mask(one, vv, _CMP_LT_OQ), vv, one), zero);
+
+        __m512 h6 = unit == HUE_TURNS ? _mm512_mul_ps(hh, six) : _mm512_div_ps(hh, k60);
+        __m512i sector = _mm512_cvttps_epi32(h6);
+        __m512 fi = _mm512_cvtepi32_ps(sector);
+        __m512 f = _mm512_sub_ps(h6, fi);
+        __m512 p = _mm512_mul_ps(vv, _mm512_sub_ps(one, ss));
+        __m512 q = _mm512_mul_ps(vv, _mm512_sub_ps(one, _mm512_mul_ps(ss, f)));
+        __m512 t = _mm512_mul_ps(vv, _mm512_sub_ps(one, _mm512_mul_ps(ss, _mm512_sub_ps(one, f))));
+
+        __m512i m = _mm512_maskz_mov_epi32(_mm512_cmplt_epi32_mask(sector, _mm512_set1_epi32(6)), sector);
+        __mmask16 m0 = _mm512_cmpeq_epi32_mask(m, _mm512_set1_epi32(0));
+        __mmask16 m1 = _mm512_cmpeq_epi32_mask(m, _mm512_set1_epi32(1));
+        __mmask16 m2 = _mm512_cmpeq_epi32_mask(m, _mm512_set1_epi32(2));
+        __mmask16 m3 = _mm512_cmpeq_epi32_mask(m, _mm512_set1_epi32(3));
+        __mmask16 m4 = _mm512_cmpeq_epi32_mask(m, _mm512_set1_epi32(4));
+        __mmask16 m5 = _mm512_cmpeq_epi32_mask(m, _mm512_set1_epi32(5));
+
+        __m512 r = vv;
+        r = _mm512_mask_blend_ps(m1, r, q);
+        r = _mm512_mask_blend_ps(m2 | m3, r, p);
+        r = _mm512_mask_blend_ps(m4, r, t);
+        __m512 g = p;
+        g = _mm512_mask_blend_ps(m0, g, t);
+        g = _mm512_mask_blend_ps(m1 | m2, g, vv);
+        g = _mm512_mask_blend_ps(m3, g, q);
+        __m512 b = p;
+        b = _mm512_mask_blend_ps(m2, b, t);
+        b = _mm512_mask_blend_ps(m3 | m4, b, vv);
+        b = _mm512_mask_blend_ps(m5, b, q);
+
+        __mmask16 gray = _mm512_cmp_ps_mask(ss, zero, _CMP_LE_OQ);
+        r = _mm512_mask_blend_ps(gray, r, vv);
+        g = _mm512_mask_blend_ps(gray, g, vv);
+        b = _mm512_mask_blend_ps(gray, b, vv);
+
+        __m512i R = _mm512_and_si512(_mm512_cvttps_epi32(_mm512_add_ps(_mm512_mul_ps(r, k255), half)), mask);
+        __m512i G = _mm512_and_si512(_mm512_cvttps_epi32(_mm512_add_ps(_mm512_mul_ps(g, k255), half)), mask);
+        __m512i B = _mm512_and_si512(_mm512_cvttps_epi32(_mm512_add_ps(_mm512_mul_ps(b, k255), half)), mask);
+        __m512i out = _mm512_or_si512(_mm512_or_si512(_mm512_slli_epi32(R, 16), _mm512_slli_epi32(G, 8)), B);
+        _mm512_storeu_si512((void *)(rgb + i), out);
+    }
+    color_hsv_to_rgb_n_avx2(h + i, s + i, v + i, rgb + i, count - i, unit);
+}
+#endif /* COLOR_X86 */
+
+#ifdef COLOR_X86
+#define COLOR_HSV_LEVELS (CPU_BIT(CPU_SSE41) | CPU_BIT(CPU_AVX2) | CPU_BIT(CPU_AVX512))
+#else
+#define COLOR_HSV_LEVELS 0
+#endif
+
+static inline void color_rgb_to_hsv_n(const rgb_t *rgb, float *h, float *s, float *v,
+                                      size_t count, hue_unit_e unit) {
+    switch (cpu_pick(COLOR_HSV_LEVELS)) {
+#ifdef COLOR_X86
+    case CPU_AVX512: color_rgb_to_hsv_n_avx512(rgb, h, s, v, count, unit); return;
+    case CPU_AVX2:   color_rgb_to_hsv_n_avx2(rgb, h, s, v, count, unit); return;
+    case CPU_SSE41:  color_rgb_to_hsv_n_sse41(rgb, h, s, v, count, unit); return;
+#endif
+    default:         color_rgb_to_hsv_n_scalar(rgb, h, s, v, count, unit); return;
+    }
+}
+
+static inline void color_hsv_to_rgb_n(const float *h, const float *s, const float *v, rgb_t *rgb,
+                                      size_t count, hue_unit_e unit) {
+    switch (cpu_pick(COLOR_HSV_LEVELS)) {
+#ifdef COLOR_X86
+    case CPU_AVX512: color_hsv_to_rgb_n_avx512(h, s, v, rgb, count, unit); return;
+    case CPU_AVX2:   color_hsv_to_rgb_n_avx2(h, s, v, rgb, count, unit); return;
+    case CPU_SSE41:  color_hsv_to_rgb_n_sse41(h, s, v, rgb, count, unit); return;
+#endif
+    default:         color_hsv_to_rgb_n_scalar(h, s, v, rgb, count, unit); return;
+    }
+}
+
+/* -- Hue bins -- */
+
+/* Hue -> class id (a color_e for the base16 scheme, anything below 256
+ * for finer ones) from a sorted list of boundaries, so the scheme is data.
+ * The hue circle is cut into HUE_BIN_STEPS equal steps and each step
+ * keeps the one boundary that may fall inside it: the class is `below`
+ * under the split and `above` from it on. A lookup is then an index, a
+ * compare and a select, exact down to the float boundary and without
+ * branches, so the batch version is a plain gather. */
+
+#define HUE_BIN_STEPS 1024
+
+/* A class starts at `start` and runs up to the next entry's start; the
+ * last one wraps around to the first. */
+typedef struct {
+    float start;
+    uint8_t id;
+} hue_bin_t;
+
+typedef struct {
+    float scale;
+    float split[HUE_BIN_STEPS];
+    int32_t below[HUE_BIN_STEPS];
+    int32_t above[HUE_BIN_STEPS];
+} hue_bins_t;
+
+/* Hue must be in [0, full) or at least finite. */
+static inline int hue_bins_step(const hue_bins_t *bins, float h) {
+    float x = h * bins->scale;
+    x = x < 0.0f ? 0.0f : x;
+    x = x > (float)(HUE_BIN_STEPS - 1) ? (float)(HUE_BIN_STEPS - 1) : x;
+    return (int)x;
+}
+
+/* False when the boundaries are unsorted, outside [0, full) or two of
+ * them land in the same step (classes narrower than 1/HUE_BIN_STEPS). */
+static inline bool hue_bins_init(hue_bins_t *bins, const hue_bin_t *table, size_t count,
+                                 hue_unit_e unit) {
+    float full = color_hue_full_f(unit);
+    bins->scale = (float)HUE_BIN_STEPS / full;
+    if (count == 0) return false;
+    for (size_t k = 0; k < count; k++) {
+        if (!(table[k].start >= 0.0f && table[k].start < full)) return false;
+        if (k > 0 && hue_bins_step(bins, table[k].start) <= hue_bins_step(bins, table[k - 1].start)) {
+            return false;
+        }
+    }
+
+    size_t next = 0;
+    int32_t current = table[count - 1].id;
+    for (int i = 0; i < HUE_BIN_STEPS; i++) {
+        bins->split[i] = 0.0f;
+        bins->below[i] = current;
+        if (next < count && hue_bins_step(bins, table[next].start) == i) {
+            bins->split[i] = table[next].start;
+            current = table[next].id;
+            next++;
+        }
+        bins->above[i] = current;
+    }
+    return true;
+}
+
+static inline uint8_t hue_bins_classify(const hue_bins_t *bins, float h) {
+    int i = hue_bins_step(bins, h);
+    return (uint8_t)(h < bins->split[i] ? bins->below[i] : bins->above[i]);
+}
+
+static inline void hue_bins_classify_n_scalar(const hue_bins_t *bins, const float *h, uint8_t *out,
+                                              size_t count) {
+    for (size_t i = 0; i < count; i++) out[i] = hue_bins_classify(bins, h[i]);
+}
+
+#ifdef COLOR_X86
+__attribute__((target("avx2"), unused))
+static void hue_bins_classify_n_avx2(const hue_bins_t *bins, const float *h, uint8_t *out,
+                                     size_t count) {
+    const __m256 scale = _mm256_set1_ps(bins->scale);
+    const __m256 zero  = _mm256_setzero_ps();
+    const __m256 last  = _mm256_set1_ps((float)(HUE_BIN_STEPS - 1));
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 hh = _mm256_loadu_ps(h + i);
+        __m256 x = _mm256_mul_ps(hh, scale);
+        x = _mm256_blendv_ps(x, zero, _mm256_cmp_ps(x, zero, _CMP_LT_OQ));
+        x = _mm256_blendv_ps(x, last, _mm256_cmp_ps(x, last, _CMP_GT_OQ));
+        __m256i step = _mm256_cvttps_epi32(x);
+
+        __m256 split = _mm256_i32gather_ps(bins->split, step, 4);
+        __m256i below = _mm256_i32gather_epi32((const int *)bins->below, step, 4);
+        __m256i above = _mm256_i32gather_epi32((const int *)bins->above, step, 4);
+        __m256i under = _mm256_castps_si256(_mm256_cmp_ps(hh, split, _CMP_LT_OQ));
+        __m256i id = _mm256_blendv_epi8(above, below, under);
+
+        __m128i words = _mm_packus_epi32(_mm256_castsi256_si128(id), _mm256_extracti128_si256(id, 1));
+        _mm_storel_epi64((__m128i *)(out + i), _mm_packus_epi16(words, words));
+    }
+    hue_bins_classify_n_scalar(bins, h + i, out + i, count - i);
+}
+
+__attribute__((target("avx512f"), unused))
+static void hue_bins_classify_n_avx512(const hue_bins_t *bins, const float *h, uint8_t *out,
+                                       size_t count) {
+    const __m512 scale = _mm512_set1_ps(bins->scale);
+    const __m512 zero  = _mm512_setzero_ps();
+    const __m512 last  = _mm512_set1_ps((float)(HUE_BIN_STEPS - 1));
+
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m512 hh = _mm512_loadu_ps(h + i);
+        __m512 x = _mm512_mul_ps(hh, scale);
+        x = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(x, zero, _CMP_LT_OQ), x, zero);
+        x = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(x, last, _CMP_GT_OQ), x, last);
+        __m512i step = _mm512_cvttps_epi32(x);
+
+        __m512 split = _mm512_i32gather_ps(step, bins->split, 4);
+        __m512i below = _mm512_i32gather_epi32(step, bins->below, 4);
+        __m512i above = _mm512_i32gather_epi32(step, bins->above, 4);
+        __mmask16 under = _mm512_cmp_ps_mask(hh, split, _CMP_LT_OQ);
+        __m512i id = _mm512_mask_blend_epi32(under, above, below);
+
+        _mm_storeu_si128((__m128i *)(out + i), _mm512_cvtepi32_epi8(id));
+    }
+    hue_bins_classify_n_avx2(bins, h + i, out + i, count - i);
+}
+#endif /* COLOR_X86 */
+
+#ifdef COLOR_X86
+#define COLOR_HUE_BINS_LEVELS (CPU_BIT(CPU_AVX2) | CPU_BIT(CPU_AVX512))
+#else
+#define COLOR_HUE_BINS_LEVELS 0
+#endif
+
+static inline void hue_bins_classify_n(const hue_bins_t *bins, const float *h, uint8_t *out, size_t count) {
+    switch (cpu_pick(COLOR_HUE_BINS_LEVELS)) {
+#ifdef COLOR_X86
+    case CPU_AVX512: hue_bins_classify_n_avx512(bins, h, out, count); return;
+    case CPU_AVX2:   hue_bins_classify_n_avx2(bins, h, out, count); return;
+#endif
+    default:         hue_bins_classify_n_scalar(bins, h, out, count); return;
+    }
+}
+
+/* -- OKLab -- */
+
+/* Perceptual space for color distances: Euclidean distance in OKLab
+ * follows how different two colors look far better than hue distance.
+ * Not constexpr (the cube root works on the float bits). */
+
+typedef struct {
+    float L, a, b;
+} oklab_t;
+
+/* sRGB byte -> linear light, the exact piecewise curve rounded to float. */
+static const float color_srgb_to_linear[256] = {
+    0.0f, 0.000303526991f, 0.000607053982f, 0.000910580973f, 0.00121410796f, 0.00151763496f,
+    0.00182116195f, 0.00212468882f, 0.00242821593f, 0.0027317428f, 0.00303526991f, 0.00334653584f,
+    0.00367650739f, 0.00402471703f, 0.00439144205f, 0.00477695325f, 0.00518151652f, 0.00560539169f,
+    0.00604883302f, 0.00651209056f, 0.00699541019f, 0.00749903219f, 0.00802319311f, 0.00856812578f,
+    0.00913405884f, 0.00972121768f, 0.010329823f, 0.0109600937f, 0.0116122449f, 0.012286488f,
+    0.0129830325f, 0.0137020834f, 0.0144438436f, 0.0152085144f, 0.0159962941f, 0.0168073755f,
+    0.0176419541f, 0.01850022f, 0.0193823613f, 0.0202885624f, 0.0212190095f, 0.0221738853f,
+    0.0231533665f, 0.0241576321f, 0.0251868591f, 0.0262412224f, 0.0273208916f, 0.02842604f,
+    0.0295568351f, 0.0307134446f, 0.0318960324f, 0.0331047662f, 0.0343398079f, 0.0356013142f,
+    0.0368894488f, 0.0382043719f, 0.0395462364f, 0.0409151986f, 0.0423114114f, 0.043735031f,
+    0.045186203f, 0.0466650873f, 0.0481718257f, 0.0497065671f, 0.0512694567f, 0.0528606474f,
+    0.054480277f, 0.0561284907f, 0.0578054301f, 0.0595112368f, 0.0612460524f, 0.0630100146f,
+    0.064803265f, 0.0666259378f, 0.0684781671f, 0.0703600943f, 0.0722718537f, 0.0742135718f,
+    0.0761853829f, 0.078187421f, 0.0802198201f, 0.0822827071f, 0.0843762085f, 0.0865004584f,
+    0.0886555836f, 0.0908417106f, 0.0930589661f, 0.0953074694f, 0.097587347f, 0.0998987257f,
+    0.102241732f, 0.104616486f, 0.107023105f, 0.10946171f, 0.111932427f, 0.114435375f,
+    0.116970666f, 0.119538426f, 0.122138776f, 0.124771819f, 0.127437681f, 0.130136475f,
+    0.13286832f, 0.135633335f, 0.138431609f, 0.141263291f, 0.144128472f, 0.147027269f,
+    0.149959788f, 0.152926147f, 0.155926466f, 0.158960834f, 0.162029371f, 0.165132195f,
+    0.168269396f, 0.171441108f, 0.174647406f, 0.177888423f, 0.18116425f, 0.18447499f,
+    0.187820777f, 0.191201687f, 0.194617838f, 0.198069319f, 0.20155625f, 0.205078736f,
+    0.208636865f, 0.212230757f, 0.215860501f, 0.219526201f, 0.223227963f, 0.226965874f,
+    0.230740055f, 0.23455058f, 0.238397568f, 0.242281124f, 0.246201321f, 0.25015828f,
+    0.254152089f, 0.258182853f, 0.262250662f, 0.266355604f, 0.270497799f, 0.274677306f,
+    0.278894275f, 0.283148736f, 0.287440836f, 0.291770637f, 0.296138257f, 0.300543785f,
+    0.304987311f, 0.309468925f, 0.313988715f, 0.318546772f, 0.323143214f, 0.327778101f,
+    0.332451522f, 0.337163627f, 0.341914415f, 0.346704066f, 0.351532608f, 0.356400132f,
+    0.361306787f, 0.366252601f, 0.371237695f, 0.376262128f, 0.38132602f, 0.386429429f,
+    0.391572475f, 0.396755219f, 0.401977777f, 0.407240212f, 0.412542611f, 0.417885065f,
+    0.423267663f, 0.428690493f, 0.434153646f, 0.439657182f, 0.445201188f, 0.450785786f,
+    0.456411034f, 0.462076992f, 0.467783809f, 0.473531485f, 0.479320168f, 0.48514995f,
+    0.491020858f, 0.496932983f, 0.502886474f, 0.50888133f, 0.514917672f, 0.520995557f,
+    0.527115107f, 0.533276379f, 0.539479494f, 0.545724452f, 0.55201143f, 0.558340371f,
+    0.564711511f, 0.571124852f, 0.577580452f, 0.584078431f, 0.590618849f, 0.597201765f,
+    0.603827357f, 0.610495567f, 0.617206573f, 0.623960376f, 0.630757153f, 0.637596846f,
+    0.644479692f, 0.651405632f, 0.658374846f, 0.665387273f, 0.672443151f, 0.679542482f,
+    0.686685324f, 0.693871737f, 0.701101899f, 0.708375752f, 0.715693474f, 0.723055124f,
+    0.730460763f, 0.73791039f, 0.745404184f, 0.752942204f, 0.760524511f, 0.768151164f,
+    0.775822222f, 0.783537805f, 0.791297913f, 0.799102724f, 0.806952238f, 0.814846575f,
+    0.822785735f, 0.830769897f, 0.838799f, 0.846873224f, 0.854992628f, 0.863157213f,
+    0.871367097f, 0.8796224f, 0.887923121f, 0.896269381f, 0.904661179f, 0.913098633f,
+    0.921581864f, 0.930110872f, 0.938685715f, 0.947306514f, 0.955973327f, 0.964686275f,
+    0.973445296f, 0.982250571f, 0.991102099f, 1.0f,
+};
+
+/* Cube root of x >= 0: a bit-level first guess refined by two Newton
+ * steps, within 2e-6 of cbrtf and written so the vector kernel can repeat
+ * it exactly. */
+static inline float color_cbrt_f(float x) {
+    if (x <= 0.0f) return 0.0f;
+    int32_t bits = 0;
+    memcpy(&bits, &x, sizeof(bits));
+    bits = (int32_t)((float)bits * (1.0f / 3.0f)) + 0x2a5137a0;
+    float y = 0.0f;
+    memcpy(&y, &bits, sizeof(y));
+    y = (y + y + x / (y * y)) * (1.0f / 3.0f);
+    y = (y + y + x / (y * y)) * (1.0f / 3.0f);
+    return y;
+}
+
+static inline oklab_t color_rgb_to_oklab(rgb_t rgb) {
+    float r = color_srgb_to_linear[(rgb >> 16) & 0xFF];
+    float g = color_srgb_to_linear[(rgb >> 8)  & 0xFF];
+    float b = color_srgb_to_linear[ rgb        & 0xFF];
+
+    float l = color_cbrt_f(0.4122214708f * r + 0.5363325363f * g + 0.0514459929f * b);
+    float m = color_cbrt_f(0.2119034982f * r + 0.6806995451f * g + 0.1073969566f * b);
+    float s = color_cbrt_f(0.0883024619f * r + 0.2817188376f * g + 0.6299787005f * b);
+
+    oklab_t out = { 0, 0, 0 };
+    out.L = 0.2104542553f * l + 0.7936177850f * m - 0.0040720468f * s;
+    out.a = 1.9779984951f * l - 2.4285922050f * m + 0.4505937099f * s;
+    out.b = 0.0259040371f * l + 0.7827717662f * m - 0.8086757660f * s;
+    return out;
+}
+
+static inline float color_oklab_distance2(oklab_t x, oklab_t y) {
+    float dL = x.L - y.L, da = x.a - y.a, db = x.b - y.b;
+    return dL * dL + da * da + db * db;
+}
+
+static inline void color_rgb_to_oklab_n_scalar(const rgb_t *rgb, float *L, float *a, float *b, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        oklab_t out = color_rgb_to_oklab(rgb[i]);
+        L[i] = out.L;
+        a[i] = out.a;
+        b[i] = out.b;
+    }
+}
+
+#ifdef COLOR_X86
+__attribute__((target("avx2"), unused))
+static inline __m256 color_cbrt_avx2(__m256 x) {
+    const __m256 third = _mm256_set1_ps(1.0f / 3.0f);
+    __m256i bits = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_castps_si256(x)), third));
+    __m256 y = _mm256_castsi256_ps(_mm256_add_epi32(bits, _mm256_set1_epi32(0x2a5137a0)));
+    for (int i = 0; i < 2; i++) {
+        __m256 y2 = _mm256_add_ps(y, y);
+        y = _mm256_mul_ps(_mm256_add_ps(y2, _mm256_div_ps(x, _mm256_mul_ps(y, y))), third);
+    }
+    return _mm256_and_ps(y, _mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_GT_OQ));
+}
+
+__attribute__((target("avx2"), unused))
+static void color_rgb_to_oklab_n_avx2(const rgb_t *rgb, float *L, float *a, float *b, size_t count) {
+    const __m256i mask = _mm256_set1_epi32(0xFF);
+#define OKLAB_ROW(x, y, z, r, g, b)                                                \
+    _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(x), r),                \
+                                _mm256_mul_ps(_mm256_set1_ps(y), g)),               \
+                  _mm256_mul_ps(_mm256_set1_ps(z), b))
+#define OKLAB_ROW_SUB(x, y, z, r, g, b)                                            \
+    _mm256_sub_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(x), r),                \
+                                _mm256_mul_ps(_mm256_set1_ps(y), g)),               \
+                  _mm256_mul_ps(_mm256_set1_ps(z), b))
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i px = _mm256_loadu_si256((const __m256i *)(rgb + i));
+        __m256 r = _mm256_i32gather_ps(color_srgb_to_linear, _mm256_and_si256(_mm256_srli_epi32(px, 16), mask), 4);
+        __m256 g = _mm256_i32gather_ps(color_srgb_to_linear, _mm256_and_si256(_mm256_srli_epi32(px, 8), mask), 4);
+        __m256 bl = _mm256_i32gather_ps(color_srgb_to_linear, _mm256_and_si256(px, mask), 4);
+
+        __m256 l = color_cbrt_avx2(OKLAB_ROW(0.4122214708f, 0.5363325363f, 0.0514459929f, r, g, bl));
+        __m256 m = color_cbrt_avx2(OKLAB_ROW(0.2119034982f, 0.6806995451f, 0.1073969566f, r, g, bl));
+        __m256 s = color_cbrt_avx2(OKLAB_ROW(0.0883024619f, 0.2817188376f, 0.6299787005f, r, g, bl));
+
+        /* a = 1.97.. l - 2.42.. m + 0.45.. s, kept in the scalar order */
+        __m256 ok_a = _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(_mm256_set1_ps(1.9779984951f), l),
+                                                  _mm256_mul_ps(_mm256_set1_ps(2.4285922050f), m)),
+                                    _mm256_mul_ps(_mm256_set1_ps(0.4505937099f), s));
+
+        _mm256_storeu_ps(L + i, OKLAB_ROW_SUB(0.2104542553f, 0.7936177850f, 0.0040720468f, l, m, s));
+        _mm256_storeu_ps(a + i, ok_a);
+        _mm256_storeu_ps(b + i, OKLAB_ROW_SUB(0.0259040371f, 0.7827717662f, 0.8086757660f, l, m, s));
+    }
+#undef OKLAB_ROW
+#undef OKLAB_ROW_SUB
+    color_rgb_to_oklab_n_scalar(rgb + i, L + i, a + i, b + i, count - i);
+}
+
+__attribute__((target("avx512f"), unused))
+static inline __m512 color_cbrt_avx512(__m512 x) {
+    const __m512 third = _mm512_set1_ps(1.0f / 3.0f);
+    __m512i bits = _mm512_cvttps_epi32(_mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_castps_si512(x)), third));
+    __m512 y = _mm512_castsi512_ps(_mm512_add_epi32(bits, _mm512_set1_epi32(0x2a5137a0)));
+    for (int i = 0; i < 2; i++) {
+        __m512 y2 = _mm512_add_ps(y, y);
+        y = _mm512_mul_ps(_mm512_add_ps(y2, _mm512_div_ps(x, _mm512_mul_ps(y, y))), third);
+    }
+    return _mm512_maskz_mov_ps(_mm512_cmp_ps_mask(x, _mm512_setzero_ps(), _CMP_GT_OQ), y);
+}
+
+__attribute__((target("avx512f"), unused))
+static void color_rgb_to_oklab_n_avx512(const rgb_t *rgb, float *L, float *a, float *b, size_t count) {
+    const __m512i mask = _mm512_set1_epi32(0xFF);
+#define OKLAB_ROW(x, y, z, r, g, b)                                                \
+    _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(_mm512_set1_ps(x), r),                \
+                                _mm512_mul_ps(_mm512_set1_ps(y), g)),               \
+                  _mm512_mul_ps(_mm512_set1_ps(z), b))
+#define OKLAB_ROW_SUB(x, y, z, r, g, b)                                            \
+    _mm512_sub_ps(_mm512_add_ps(_mm512_mul_ps(_mm512_set1_ps(x), r),                \
+                                _mm512_mul_ps(_mm512_set1_ps(y), g)),               \
+                  _mm512_mul_ps(_mm512_set1_ps(z), b))
+
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m512i px = _mm512_loadu_si512((const void *)(rgb + i));
+        __m512 r = _mm512_i32gather_ps(_mm512_and_si512(_mm512_srli_epi32(px, 16), mask), color_srgb_to_linear, 4);
+        __m512 g = _mm512_i32gather_ps(_mm512_and_si512(_mm512_srli_epi32(px, 8), mask), color_srgb_to_linear, 4);
+        __m512 bl = _mm512_i32gather_ps(_mm512_and_si512(px, mask), color_srgb_to_linear, 4);
+
+        __m512 l = color_cbrt_avx512(OKLAB_ROW(0.4122214708f, 0.5363325363f, 0.0514459929f, r, g, bl));
+        __m512 m = color_cbrt_avx512(OKLAB_ROW(0.2119034982f, 0.6806995451f, 0.1073969566f, r, g, bl));
+        __m512 s = color_cbrt_avx512(OKLAB_ROW(0.0883024619f, 0.2817188376f, 0.6299787005f, r, g, bl));
+
+        __m512 ok_a = _mm512_add_ps(_mm512_sub_ps(_mm512_mul_ps(_mm512_set1_ps(1.9779984951f), l),
+                                                  _mm512_mul_ps(_mm512_set1_ps(2.4285922050f), m)),
+                                    _mm512_mul_ps(_mm512_set1_ps(0.4505937099f), s));
+
+        _mm512_storeu_ps(L + i, OKLAB_ROW_SUB(0.2104542553f, 0.7936177850f, 0.0040720468f, l, m, s));
+        _mm512_storeu_ps(a + i, ok_a);
+        _mm512_storeu_ps(b + i, OKLAB_ROW_SUB(0.0259040371f, 0.7827717662f, 0.8086757660f, l, m, s));
+    }
+#undef OKLAB_ROW
+#undef OKLAB_ROW_SUB
+    color_rgb_to_oklab_n_avx2(rgb + i, L + i, a + i, b + i, count - i);
+}
+#endif /* COLOR_X86 */
+
+#ifdef COLOR_X86
+#define COLOR_OKLAB_LEVELS (CPU_BIT(CPU_AVX2) | CPU_BIT(CPU_AVX512))
+#else
+#define COLOR_OKLAB_LEVELS 0
+#endif
+
+/* The vector kernels are bit-identical to color_rgb_to_oklab. */
+static inline void color_rgb_to_oklab_n(const rgb_t *rgb, float *L, float *a, float *b, size_t count) {
+    switch (cpu_pick(COLOR_OKLAB_LEVELS)) {
+#ifdef COLOR_X86
+    case CPU_AVX512: color_rgb_to_oklab_n_avx512(rgb, L, a, b, count); return;
+    case CPU_AVX2:   color_rgb_to_oklab_n_avx2(rgb, L, a, b, count); return;
+#endif
+    default:         color_rgb_to_oklab_n_scalar(rgb, L, a, b, count); return;
+    }
+}
+
+#ifdef __cplusplus
+namespace color {
+
+struct turns   { static constexpr hue_unit_e unit = HUE_TURNS; };
+struct degrees { static constexpr hue_unit_e unit = HUE_DEGREES; };
+
+template <typename T> struct hsv_of;
+template <> struct hsv_of<float>  { using type = hsv_t; };
+template <> struct hsv_of<double> { using type = hsvd_t; };
+
+// color::space<float, color::degrees>::from_rgb(0xff8000) and friends.
+template <typename T, typename Unit>
+struct space {
+    using hsv = typename hsv_of<T>::type;
+    static constexpr hue_unit_e unit = Unit::unit;
+    static constexpr T full = unit == HUE_TURNS ? T(1) : T(360);
+
+    static constexpr hsv from_rgb(rgb_t rgb) {
+        if constexpr (sizeof(T) == sizeof(float)) return color_rgb_to_hsv_f(rgb, unit);
+        else return color_rgb_to_hsv_d(rgb, unit);
+    }
+
+    static constexpr rgb_t to_rgb(hsv c) {
+        if constexpr (sizeof(T) == sizeof(float)) return color_hsv_to_rgb_f(c, unit);
+        else return color_hsv_to_rgb_d(c, unit);
+    }
+
+    static constexpr T wrap(T h) {
+        if constexpr (sizeof(T) == sizeof(float)) return color_wrap_hue_f(h, unit);
+        else return color_wrap_hue_d(h, unit);
+    }
+
+    static constexpr T base_hue(color_e c) {
+        if constexpr (sizeof(T) == sizeof(float)) return color_base_hue_f(c, unit);
+        else return color_base_hue_d(c, unit);
+    }
+
+    static void from_rgb_n(const rgb_t *rgb, T *h, T *s, T *v, size_t count) {
+        static_assert(sizeof(T) == sizeof(float), "batch conversions are float only");
+        color_rgb_to_hsv_n(rgb, h, s, v, count, unit);
+    }
+
+    static void to_rgb_n(const T *h, const T *s, const T *v, rgb_t *rgb, size_t count) {
+        static_assert(sizeof(T) == sizeof(float), "batch conversions are float only");
+        color_hsv_to_rgb_n(h, s, v, rgb, count, unit);
+    }
+};
+
+static_assert(space<float, degrees>::to_rgb(space<float, degrees>::from_rgb(0xff8000)) == 0xff8000,
+              "constexpr round trip");
+
+} // namespace color
+#endif /* __cplusplus */
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#pragma GCC pop_options
+#endif
+
+#endif /* COLOR_H */
@@ -0,0 +1,4 @@
+#include "color_lut.h"
+
+/* Generated, `const uint16_t color_lut[LUT_SIZE] = { ... };` */
+#include "color_lut_table.h"
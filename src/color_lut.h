@@ -0,0 +1,38 @@
+#ifndef COLOR_LUT_H
+#define COLOR_LUT_H
+
+#include <stdint.h>
+
+#include "helper.h"
+
+/* Per 5-5-5 RGB cell: one bit per config.h threshold the color passes,
+ * and the hue quantized to 8 bits (entry >> LUT_HUE_SHIFT). The table is
+ * generated at build time by tools/gen_color_lut.c from config.h and
+ * helper.c, see color_lut_table.h.
+ *
+ * A cell covers 512 colors, which do not always agree: LUT_UNIFORM is
+ * only set when all the threshold bits are the same for every one of
+ * them, otherwise ask the exact code. The hue is the one of the cell
+ * center. */
+#define LUT_SIZE 32768
+
+#define LUT_V_MIN       0x0008 /* v >= min_lightness */
+#define LUT_V_MAX       0x0010 /* v <= max_lightness */
+#define LUT_S_MIN       0x0020 /* s >= min_saturation */
+#define LUT_S_MAX       0x0040 /* s <= max_saturation */
+#define LUT_UNIFORM     0x0080
+#define LUT_HUE_SHIFT   8
+
+#define LUT_ACCENT (LUT_V_MIN | LUT_V_MAX | LUT_S_MIN | LUT_S_MAX)
+
+extern const uint16_t color_lut[LUT_SIZE];
+
+static inline uint32_t color_lut_index(rgb_t rgb) {
+    return ((rgb >> 9) & 0x7C00) | ((rgb >> 6) & 0x03E0) | ((rgb >> 3) & 0x001F);
+}
+
+static inline uint16_t color_lut_lookup(rgb_t rgb) {
+    return color_lut[color_lut_index(rgb)];
+}
+
+#endif /* COLOR_LUT_H */
@@ -1,12 +1,19 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+#include "color.h"
+
 static const float max_lightness  = 0.80;
 static const float min_lightness  = 0.45;
 static const float min_saturation = 0.15;
 static const float max_saturation = 0.78;
 
-static const float second_color_hue_diff = 0.083;
+/* The saturation window of the colorful palette (-c), lightness keeps
+ * the one above. */
+static const float colorful_min_saturation = 0.45;
+static const float colorful_max_saturation = 1.0;
+
+static const float second_color_oklab_diff = 0.1;
 
 static const float bg_color_value          = 0.08;
 static const float bg_color_value_alt_diff = 0.12;
@@ -14,4 +21,31 @@ static const float bg_min_value_diff       = 0.38;
 
 static const float color_hue_range = 0.04;
 
+/* Least WCAG contrast ratio every foreground color and accent keeps
+ * against color00 and color08 (3 is the WCAG minimum for large text and
+ * UI, 4.5 for text), 1 to leave them as generated. */
+static const float min_fg_contrast = 3.0;
+
+/* How many representative colors the quantizing engines (--engine)
+ * reduce the image to before the accents are picked among them. */
+static const size_t engine_swatches = 8;
+
+/* hue-peak engine: width (standard deviation, in turns) of the gaussian
+ * the hue density is smoothed with, and how prominent a peak must be,
+ * as a share of the highest one, to be more than noise. */
+static const float hue_peak_sigma          = 0.01;
+static const float hue_peak_min_prominence = 0.01;
+
+/* Hue classes in turns (degrees / 360): each one starts at its boundary
+ * and runs up to the next, the last wraps around to the first. Any sorted
+ * list works, ids are what tell_color returns. */
+static const hue_bin_t hue_bins[] = {
+    { 0.0416f, ORANGE  },
+    { 0.2083f, GREEN   },
+    { 0.4167f, CYAN    },
+    { 0.5833f, BLUE    },
+    { 0.75f,   MAGENTA },
+    { 0.9167f, RED     },
+};
+
 #endif /* CONFIG_H */
@@ -0,0 +1,157 @@
+#include <math.h>
+#include <pthread.h>
+
+#include "contrast.h"
+
+/* Solved in chunks, the working set of a chunk lives on the stack. */
+#define CONTRAST_CHUNK 32
+
+static float linear[256];
+static pthread_once_t linear_once = PTHREAD_ONCE_INIT;
+
+static void linear_init(void) {
+    for (int i = 0; i < 256; i++) {
+        double c = i / 255.0;
+        linear[i] = (float)(c <= 0.04045 ? c / 12.92 : pow((c + 0.055) / 1.055, 2.4));
+    }
+}
+
+static float channels_luminance(int r, int g, int b) {
+    return 0.2126f * linear[r] + 0.7152f * linear[g] + 0.0722f * linear[b];
+}
+
+float contrast_luminance(rgb_t rgb) {
+    pthread_once(&linear_once, linear_init);
+    return channels_luminance((rgb >> 16) & 0xFF, (rgb >> 8) & 0xFF, rgb & 0xFF);
+}
+
+float contrast_ratio(rgb_t a, rgb_t b) {
+    float ya = contrast_luminance(a), yb = contrast_luminance(b);
+    return ya > yb ? (ya + 0.05f) / (yb + 0.05f) : (yb + 0.05f) / (ya + 0.05f);
+}
+
+/* A color with `max` as its largest channel, the others in proportion. */
+typedef struct {
+    float r[CONTRAST_CHUNK], g[CONTRAST_CHUNK], b[CONTRAST_CHUNK];
+} shape_t;
+
+static int scaled(float ratio, int max) {
+    return (int)(ratio * max + 0.5f);
+}
+
+static float shape_luminance(const shape_t *shape, size_t i, int max) {
+    return channels_luminance(scaled(shape->r[i], max), scaled(shape->g[i], max), scaled(shape->b[i], max));
+}
+
+/* The lower of the contrasts of luminance `y` with the two backgrounds. */
+static float worst_ratio(float y, float bg_low, float bg_high) {
+    float with_low = y > bg_low ? (y + 0.05f) / (bg_low + 0.05f) : (bg_low + 0.05f) / (y + 0.05f);
+    float with_high = y > bg_high ? (y + 0.05f) / (bg_high + 0.05f) : (bg_high + 0.05f) / (y + 0.05f);
+    return with_low < with_high ? with_low : with_high;
+}
+
+static void solve_chunk(rgb_t *colors, size_t count, float bg_low, float bg_high, float min_ratio) {
+    /* What a color needs to clear every background, lighter or darker. */
+    float need_up = (bg_high + 0.05f) * min_ratio - 0.05f;
+    float need_down = (bg_low + 0.05f) / min_ratio - 0.05f;
+    /* Where black and white contrast as much with the backgrounds. */
+    bool dark = (bg_high + 0.05f) * (bg_low + 0.05f) < 1.05f * 0.05f;
+
+    shape_t shape;
+    int lo[CONTRAST_CHUNK], hi[CONTRAST_CHUNK];
+    bool up[CONTRAST_CHUNK];
+    for (size_t i = 0; i < count; i++) {
+        int r = (colors[i] >> 16) & 0xFF, g = (colors[i] >> 8) & 0xFF, b = colors[i] & 0xFF;
+        int max = r > g ? (r > b ? r : b) : (g > b ? g : b);
+        shape.r[i] = max ? (float)r / max : 1.0f;
+        shape.g[i] = max ? (float)g / max : 1.0f;
+        shape.b[i] = max ? (float)b / max : 1.0f;
+
+        float now = shape_luminance(&shape, i, max);
+        bool can_up = shape_luminance(&shape, i, 255) >= need_up;
+        /* Down stops short of black, which has no hue left. */
+        bool can_down = shape_luminance(&shape, i, 1) <= need_down;
+        lo[i] = hi[i] = max;
+        up[i] = dark;
+        if (now >= need_up || now <= need_down) continue;
+
+        if (dark ? !can_up && can_down : !can_down && can_up) up[i] = !dark;
+        if (up[i] ? can_up : can_down) {
+            /* Up: lo fails and hi passes, down: lo passes and hi fails. */
+            if (up[i]) hi[i] = 255;
+            else lo[i] = 1;
+        } else if (worst_ratio(shape_luminance(&shape, i, 255), bg_low, bg_high) >
+                   worst_ratio(now, bg_low, bg_high)) {
+            /* Out of reach both ways: the top keeps the hue, black would
+             * not, so the top when it helps and otherwise no move. */
+            lo[i] = hi[i] = 255;
+        }
+    }
+
+    for (int step = 0; step < CONTRAST_STEPS; step++) {
+        for (size_t i = 0; i < count; i++) {
+            if (hi[i] - lo[i] <= 1) continue;
+            int mid = (lo[i] + hi[i]) / 2;
+            float y = shape_luminance(&shape, i, mid);
+            bool pass = up[i] ? y >= need_up : y <= need_down;
+            if (pass == up[i]) hi[i] = mid;
+            else lo[i] = mid;
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        int max = up[i] ? hi[i] : lo[i];
+        colors[i] = (rgb_t)scaled(shape.r[i], max) << 16 | (rgb_t)scaled(shape.g[i], max) << 8 |
+                    (rgb_t)scaled(shape.b[i], max);
+    }
+}
+
+void contrast_solve(rgb_t *colors, size_t count, const rgb_t *backgrounds, size_t background_count,
+                    float min_ratio) {
+    if (min_ratio <= 1.0f || background_count == 0) return;
+    pthread_once(&linear_once, linear_init);
+
+    float bg_low = 1.0f, bg_high = 0.0f;
+    for (size_t i = 0; i < background_count; i++) {
+        float y = contrast_luminance(backgrounds[i]);
+        if (y < bg_low) bg_low = y;
+        if (y > bg_high) bg_high = y;
+    }
+    for (size_t start = 0; start < count; start += CONTRAST_CHUNK) {
+        size_t chunk = count - start < CONTRAST_CHUNK ? count - start : CONTRAST_CHUNK;
+        solve_chunk(colors + start, chunk, bg_low, bg_high, min_ratio);
+    }
+}
+
+/* `rgb` moved `amount` of 255 of the way to black (`dark`) or white. */
+static rgb_t towards_end(rgb_t rgb, bool dark, int amount) {
+    rgb_t out = 0;
+    for (int shift = 16; shift >= 0; shift -= 8) {
+        int c = (rgb >> shift) & 0xFF;
+        c = dark ? (c * (255 - amount) + 127) / 255 : c + ((255 - c) * amount + 127) / 255;
+        out |= (rgb_t)c << shift;
+    }
+    return out;
+}
+
+void contrast_backgrounds(rgb_t *backgrounds, size_t count, bool dark, float min_ratio) {
+    if (min_ratio <= 1.0f) return;
+    pthread_once(&linear_once, linear_init);
+
+    /* Black and white contrast the same with the middle. */
+    float middle = sqrtf(1.05f * 0.05f) - 0.05f;
+    float need = dark ? (middle + 0.05f) / min_ratio - 0.05f : (middle + 0.05f) * min_ratio - 0.05f;
+    for (size_t i = 0; i < count; i++) {
+        float y = contrast_luminance(backgrounds[i]);
+        if (dark ? y <= need : y >= need) continue;
+        /* lo fails, hi passes or is the end. */
+        int lo = 0, hi = 255;
+        while (hi - lo > 1) {
+            int mid = (lo + hi) / 2;
+            y = contrast_luminance(towards_end(backgrounds[i], dark, mid));
+            if (dark ? y <= need : y >= need) hi = mid;
+            else lo = mid;
+        }
+        backgrounds[i] = towards_end(backgrounds[i], dark, hi);
+    }
+}
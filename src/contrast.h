@@ -0,0 +1,38 @@
+#ifndef CONTRAST_H
+#define CONTRAST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "helper.h"
+
+/* WCAG 2 contrast: relative luminance from linearized sRGB, and the ratio
+ * (lighter + 0.05) / (darker + 0.05), from 1 to 21. */
+float contrast_luminance(rgb_t rgb);
+float contrast_ratio(rgb_t a, rgb_t b);
+
+/* Moves every one of `colors` along its own lightness just far enough to
+ * reach `min_ratio` against each of `backgrounds`, away from them (lighter
+ * on dark backgrounds, darker on light ones, the other way when that can
+ * not get there). A color out of reach both ways goes to its lightest
+ * when that contrasts more and is left alone otherwise, never to black.
+ * Colors that already pass are left alone. r, g and b are scaled
+ * together, so hue and saturation stay.
+ *
+ * Luminance only grows with the scale, so each color is a bisection over
+ * the 256 values of its largest channel: a fixed CONTRAST_STEPS steps run
+ * on all the colors at once. A `min_ratio` of 1 or less does nothing. */
+#define CONTRAST_STEPS 8
+
+void contrast_solve(rgb_t *colors, size_t count, const rgb_t *backgrounds, size_t background_count,
+                    float min_ratio);
+
+/* Moves each of `backgrounds` towards black (`dark`) or white as little as
+ * it takes for the middle luminance, the one black and white contrast the
+ * same with, to reach `min_ratio` on it. Foregrounds then get there on
+ * their side without losing their hue, where a mid-tone background leaves
+ * them no room. Darker scales r, g and b, lighter mixes them with white,
+ * the hue stays; one that can not get there ends at black or white. */
+void contrast_backgrounds(rgb_t *backgrounds, size_t count, bool dark, float min_ratio);
+
+#endif /* CONTRAST_H */
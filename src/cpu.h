@@ -0,0 +1,95 @@
+#ifndef CPU_H
+#define CPU_H
+
+/* Runtime choice of the SIMD level for the hot kernels, so one binary
+ * runs everywhere and still uses what the CPU has. The CPU is probed once
+ * (cpuid through __builtin_cpu_supports); `cpu_force` caps the level below
+ * that, for benchmarks and for checking the narrower paths. Each kernel
+ * runs its best variant at or below cpu_level(), see `cpu_pick`.
+ * Probe before starting threads, the result is cached unlocked.
+ *
+ * Define CPU_IMPLEMENTATION in exactly one translation unit. */
+
+#include <stdbool.h>
+
+typedef enum {
+    CPU_SCALAR,
+    CPU_SSE2,
+    CPU_SSE41,
+    CPU_AVX2,
+    CPU_AVX512,
+    CPU_LEVEL_COUNT,
+} cpu_level_e;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+cpu_level_e cpu_detected(void);
+cpu_level_e cpu_level(void);
+/* Cap the level, false when the name is unknown or the CPU lacks it. */
+bool cpu_force(const char *name);
+const char *cpu_level_name(cpu_level_e level);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define CPU_BIT(level) (1u << (level))
+
+/* The highest of a kernel's `levels` (CPU_BIT set) allowed right now. */
+static inline cpu_level_e cpu_pick(unsigned levels) {
+    for (int level = cpu_level(); level > CPU_SCALAR; level--) {
+        if (levels & CPU_BIT(level)) return (cpu_level_e)level;
+    }
+    return CPU_SCALAR;
+}
+
+#ifdef CPU_IMPLEMENTATION
+
+#include <string.h>
+
+static const char *cpu_level_names[CPU_LEVEL_COUNT] = {
+    "scalar", "sse2", "sse4.1", "avx2", "avx512",
+};
+
+static cpu_level_e cpu_detected_level = CPU_LEVEL_COUNT;
+static cpu_level_e cpu_forced_level = CPU_LEVEL_COUNT;
+
+cpu_level_e cpu_detected(void) {
+    if (cpu_detected_level == CPU_LEVEL_COUNT) {
+        cpu_level_e level = CPU_SCALAR;
+#if defined(__x86_64__)
+        __builtin_cpu_init();
+        /* Each level implies the ones below, kernels fall back on them. */
+        if (__builtin_cpu_supports("sse2")) level = CPU_SSE2;
+        if (level == CPU_SSE2 && __builtin_cpu_supports("sse4.1")) level = CPU_SSE41;
+        if (level == CPU_SSE41 && __builtin_cpu_supports("avx2")) level = CPU_AVX2;
+        if (level == CPU_AVX2 && __builtin_cpu_supports("avx512f")) level = CPU_AVX512;
+#endif
+        cpu_detected_level = level;
+    }
+    return cpu_detected_level;
+}
+
+cpu_level_e cpu_level(void) {
+    cpu_level_e detected = cpu_detected();
+    return cpu_forced_level < detected ? cpu_forced_level : detected;
+}
+
+bool cpu_force(const char *name) {
+    for (int i = 0; i < CPU_LEVEL_COUNT; i++) {
+        if (strcmp(name, cpu_level_names[i]) != 0) continue;
+        if ((cpu_level_e)i > cpu_detected()) return false;
+        cpu_forced_level = (cpu_level_e)i;
+        return true;
+    }
+    return false;
+}
+
+const char *cpu_level_name(cpu_level_e level) {
+    return level < CPU_LEVEL_COUNT ? cpu_level_names[level] : "unknown";
+}
+
+#endif /* CPU_IMPLEMENTATION */
+#endif /* CPU_H */
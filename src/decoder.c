@@ -0,0 +1,217 @@
+#define STB_IMAGE_IMPLEMENTATION
+#define JPEG_RST_IMPLEMENTATION
+#define PNG_PIPE_IMPLEMENTATION
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "stb_image.h"
+#include "jpeg_rst.h"
+#include "png_pipe.h"
+#include "decoder.h"
+
+/* -- stb_image -- */
+
+static bool stb_probe(format_e format) {
+    return format == FORMAT_PNG || format == FORMAT_JPEG;
+}
+
+static bool stb_info(const unsigned char *buffer, size_t len, int *width, int *height) {
+    int n;
+    return stbi_info_from_memory(buffer, len, width, height, &n) != 0;
+}
+
+static unsigned char *stb_decode_full(const unsigned char *buffer, size_t len, int *width, int *height) {
+    int n;
+    return stbi_load_from_memory(buffer, len, width, height, &n, 4);
+}
+
+/* stb_image has no reduced decode: this costs a full decode and holds the
+ * whole image, more than streaming it with decode_rows. */
+static unsigned char *stb_decode_scaled(const unsigned char *buffer, size_t len, int target_side,
+                                        int *width, int *height) {
+    unsigned char *image = stb_decode_full(buffer, len, width, height);
+    if (!image) return NULL;
+    return decoder_downscale(image, width, height, target_side);
+}
+
+/* The threaded restart-interval JPEG and pipelined PNG decoders, both
+ * built on stb_image internals so they give the exact same pixels. */
+static bool stb_decode_rows(const unsigned char *buffer, size_t len, size_t mem_budget,
+                            int *width, int *height, decoder_row_fn fn, void *user) {
+    switch (detect_format_memory(buffer, len)) {
+    case FORMAT_JPEG: return jpeg_rst_decode(buffer, len, mem_budget, width, height, fn, user);
+    case FORMAT_PNG:  return png_pipe_decode(buffer, len, mem_budget, width, height, fn, user);
+    default:          return false;
+    }
+}
+
+static void stb_free_image(unsigned char *image) {
+    stbi_image_free(image);
+}
+
+static const char *stb_failure_reason(void) {
+    return stbi_failure_reason();
+}
+
+static const decoder_t decoder_stb = {
+    .name           = "stb",
+    .probe          = stb_probe,
+    .info           = stb_info,
+    .decode_full    = stb_decode_full,
+    .decode_scaled  = stb_decode_scaled,
+    .decode_rows    = stb_decode_rows,
+    .free_image     = stb_free_image,
+    .failure_reason = stb_failure_reason,
+};
+
+/* -- Registry -- */
+
+static const decoder_t *decoders[] = {
+#ifdef HAVE_LIBJPEG
+    &decoder_libjpeg,
+#endif
+    &decoder_stb,
+#ifdef HAVE_LIBPNG
+    &decoder_libpng,
+#endif
+};
+
+#define DECODER_COUNT (sizeof(decoders) / sizeof(decoders[0]))
+
+size_t decoder_count(void) {
+    return DECODER_COUNT;
+}
+
+const decoder_t *decoder_get(size_t index) {
+    return index < DECODER_COUNT ? decoders[index] : NULL;
+}
+
+const decoder_t *decoder_find(const char *name) {
+    for (size_t i = 0; i < DECODER_COUNT; i++) {
+        if (strcmp(decoders[i]->name, name) == 0) return decoders[i];
+    }
+    return NULL;
+}
+
+const decoder_t *decoder_for_format(format_e format) {
+    for (size_t i = 0; i < DECODER_COUNT; i++) {
+        if (decoders[i]->probe(format)) return decoders[i];
+    }
+    return NULL;
+}
+
+unsigned char *decoder_downscale(unsigned char *image, int *width, int *height, int target_side) {
+    int longer = *width > *height ? *width : *height;
+    int factor = target_side > 0 ? longer / target_side : 1;
+    if (factor <= 1) return image;
+
+    int w = *width / factor, h = *height / factor;
+    if (w < 1) w = 1;
+    if (h < 1) h = 1;
+
+    /* Box average, in place: every output pixel lands before any input
+     * pixel that is still to be read. */
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            uint32_t sum[4] = {0};
+            for (int dy = 0; dy < factor; dy++) {
+                const unsigned char *src = image + (((size_t)(y * factor + dy)) * *width + (size_t)x * factor) * 4;
+                for (int dx = 0; dx < factor * 4; dx++) sum[dx & 3] += src[dx];
+            }
+            unsigned char *dst = image + ((size_t)y * w + x) * 4;
+            for (int c = 0; c < 4; c++) dst[c] = sum[c] / (uint32_t)(factor * factor);
+        }
+    }
+
+    *width = w;
+    *height = h;
+    return image;
+}
+
+/* -- Benchmark -- */
+
+#define BENCH_ROUNDS 3
+
+typedef double (*bench_fn)(const decoder_t *d, const unsigned char *buffer, size_t len);
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void bench_row(void *user, size_t worker, const unsigned char *rgba, int width, int y) {
+    (void)user; (void)worker; (void)rgba; (void)width; (void)y;
+}
+
+static double bench_info(const decoder_t *d, const unsigned char *buffer, size_t len) {
+    int w, h;
+    double start = now_ms();
+    if (!d->info(buffer, len, &w, &h)) return -1;
+    return now_ms() - start;
+}
+
+static double bench_full(const decoder_t *d, const unsigned char *buffer, size_t len) {
+    int w, h;
+    double start = now_ms();
+    unsigned char *image = d->decode_full(buffer, len, &w, &h);
+    if (!image) return -1;
+    double took = now_ms() - start;
+    d->free_image(image);
+    return took;
+}
+
+static double bench_scaled(const decoder_t *d, const unsigned char *buffer, size_t len) {
+    int w, h;
+    double start = now_ms();
+    unsigned char *image = d->decode_scaled(buffer, len, 256, &w, &h);
+    if (!image) return -1;
+    double took = now_ms() - start;
+    d->free_image(image);
+    return took;
+}
+
+static double bench_rows(const decoder_t *d, const unsigned char *buffer, size_t len) {
+    int w, h;
+    if (!d->decode_rows) return -1;
+    double start = now_ms();
+    if (!d->decode_rows(buffer, len, 0, &w, &h, bench_row, NULL)) return -1;
+    return now_ms() - start;
+}
+
+/* Best of a few rounds, negative when unsupported. */
+static double bench_best(bench_fn fn, const decoder_t *d, const unsigned char *buffer, size_t len) {
+    double best = -1;
+    for (int i = 0; i < BENCH_ROUNDS; i++) {
+        double took = fn(d, buffer, len);
+        if (took < 0) return -1;
+        if (best < 0 || took < best) best = took;
+    }
+    return best;
+}
+
+static void bench_print(FILE *out, double ms) {
+    if (ms < 0) fprintf(out, " %10s", "-");
+    else fprintf(out, " %10.2f", ms);
+}
+
+void decoder_benchmark(const unsigned char *buffer, size_t len, FILE *out) {
+    format_e format = detect_format_memory(buffer, len);
+    int w = 0, h = 0;
+    stb_info(buffer, len, &w, &h);
+
+    fprintf(out, "%s %dx%d, best of %d, ms\n", format_to_str(format), w, h, BENCH_ROUNDS);
+    fprintf(out, "%-8s %10s %10s %10s %10s\n", "decoder", "info", "full", "scaled", "rows");
+    for (size_t i = 0; i < DECODER_COUNT; i++) {
+        const decoder_t *d = decoders[i];
+        if (!d->probe(format)) continue;
+        fprintf(out, "%-8s", d->name);
+        bench_print(out, bench_best(bench_info, d, buffer, len));
+        bench_print(out, bench_best(bench_full, d, buffer, len));
+        bench_print(out, bench_best(bench_scaled, d, buffer, len));
+        bench_print(out, bench_best(bench_rows, d, buffer, len));
+        fprintf(out, "\n");
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef DECODER_H
+#define DECODER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "magician.h"
+
+/* Receives one decoded RGBA row; `worker` is below parallel_thread_count()
+ * and rows may arrive out of order from several threads at once. */
+typedef void (*decoder_row_fn)(void *user, size_t worker, const unsigned char *rgba, int width, int y);
+
+/* A decoder backend. Everything works on the whole file in memory and
+ * hands out 4 channel RGBA, released with `free_image`.
+ *
+ * - probe: whether the backend wants this format.
+ * - info: dimensions without decoding.
+ * - decode_full: the whole image.
+ * - decode_scaled: reduced by the coarsest factor the backend supports
+ *   that keeps the longer side at or above `target_side`.
+ * - decode_rows: stream rows without holding the image, within about
+ *   `mem_budget` bytes when non zero. Returns false when the file is not
+ *   one it can stream (rows may already have been delivered by then).
+ *   May be NULL. */
+typedef struct {
+    const char *name;
+    bool (*probe)(format_e format);
+    bool (*info)(const unsigned char *buffer, size_t len, int *width, int *height);
+    unsigned char *(*decode_full)(const unsigned char *buffer, size_t len, int *width, int *height);
+    unsigned char *(*decode_scaled)(const unsigned char *buffer, size_t len, int target_side,
+                                    int *width, int *height);
+    bool (*decode_rows)(const unsigned char *buffer, size_t len, size_t mem_budget,
+                        int *width, int *height, decoder_row_fn fn, void *user);
+    void (*free_image)(unsigned char *image);
+    const char *(*failure_reason)(void);
+} decoder_t;
+
+/* Backends compiled in, in order of preference. */
+size_t decoder_count(void);
+const decoder_t *decoder_get(size_t index);
+const decoder_t *decoder_find(const char *name);
+
+/* First backend that takes `format`. */
+const decoder_t *decoder_for_format(format_e format);
+
+/* For backends: box-filter `image` in place by the largest integer factor
+ * that keeps the longer side at or above `target_side`. */
+unsigned char *decoder_downscale(unsigned char *image, int *width, int *height, int target_side);
+
+#ifdef HAVE_LIBJPEG
+extern const decoder_t decoder_libjpeg;
+#endif
+#ifdef HAVE_LIBPNG
+extern const decoder_t decoder_libpng;
+#endif
+
+/* Time every backend that takes the format of `buffer` and print a table. */
+void decoder_benchmark(const unsigned char *buffer, size_t len, FILE *out);
+
+#endif /* DECODER_H */
@@ -0,0 +1,196 @@
+#ifdef HAVE_LIBJPEG
+
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <jpeglib.h>
+
+#include "decoder.h"
+
+/* libjpeg(-turbo) backend: single threaded, but it streams the scanlines
+ * of a baseline file in constant memory and scales in the DCT domain,
+ * which makes it the cheap choice for big non restart-marked JPEGs and
+ * for reduced decodes. A progressive (or any multi-scan) file goes
+ * through one coefficient buffer for the whole image instead. */
+
+typedef struct {
+    struct jpeg_error_mgr pub;
+    jmp_buf jump;
+} libjpeg_error_t;
+
+static _Thread_local char libjpeg_reason[JMSG_LENGTH_MAX];
+
+static void libjpeg_error_exit(j_common_ptr cinfo) {
+    libjpeg_error_t *err = (libjpeg_error_t *)cinfo->err;
+    (*cinfo->err->format_message)(cinfo, libjpeg_reason);
+    longjmp(err->jump, 1);
+}
+
+/* Warnings about corrupt data are not worth a line on stderr. */
+static void libjpeg_output_message(j_common_ptr cinfo) {
+    (void)cinfo;
+}
+
+static bool libjpeg_probe(format_e format) {
+    return format == FORMAT_JPEG;
+}
+
+static bool libjpeg_info(const unsigned char *buffer, size_t len, int *width, int *height) {
+    struct jpeg_decompress_struct cinfo;
+    libjpeg_error_t err;
+    cinfo.err = jpeg_std_error(&err.pub);
+    err.pub.error_exit = libjpeg_error_exit;
+    err.pub.output_message = libjpeg_output_message;
+    if (setjmp(err.jump)) {
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, (unsigned char *)buffer, len);
+    jpeg_read_header(&cinfo, TRUE);
+    *width = cinfo.image_width;
+    *height = cinfo.image_height;
+    jpeg_destroy_decompress(&cinfo);
+    return true;
+}
+
+/* Bytes of the whole-image coefficient buffer of a multi-scan file, 0
+ * for a single scan one, which decodes a row of blocks at a time. */
+static size_t libjpeg_coefficient_bytes(j_decompress_ptr cinfo) {
+    if (!jpeg_has_multiple_scans(cinfo)) return 0;
+    size_t total = 0;
+    for (int c = 0; c < cinfo->num_components; c++) {
+        const jpeg_component_info *comp = &cinfo->comp_info[c];
+        size_t w = (comp->width_in_blocks + comp->h_samp_factor - 1) / comp->h_samp_factor * comp->h_samp_factor;
+        size_t h = (comp->height_in_blocks + comp->v_samp_factor - 1) / comp->v_samp_factor * comp->v_samp_factor;
+        total += w * h * sizeof(JBLOCK);
+    }
+    return total;
+}
+
+/* Decode at the coarsest 1/2^k scale that keeps the longer side at or
+ * above `target_side` (0 for full size), either into a new RGBA image
+ * (`fn` NULL) or streaming every row to `fn`. With `mem_budget` (0: no
+ * limit), a file whose coefficient buffer does not fit in it fails before
+ * any row, and libjpeg is held to it for its own allocations. */
+static unsigned char *libjpeg_decode(const unsigned char *buffer, size_t len, int target_side, size_t mem_budget,
+                                     int *width, int *height, decoder_row_fn fn, void *user, bool *ok) {
+    struct jpeg_decompress_struct cinfo;
+    libjpeg_error_t err;
+    unsigned char *volatile image = NULL;
+    unsigned char *volatile row = NULL;
+    *ok = false;
+
+    cinfo.err = jpeg_std_error(&err.pub);
+    err.pub.error_exit = libjpeg_error_exit;
+    err.pub.output_message = libjpeg_output_message;
+    if (setjmp(err.jump)) {
+        jpeg_destroy_decompress(&cinfo);
+        free(image);
+        free(row);
+        return NULL;
+    }
+
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, (unsigned char *)buffer, len);
+    jpeg_read_header(&cinfo, TRUE);
+
+    if (mem_budget) {
+        if (libjpeg_coefficient_bytes(&cinfo) > mem_budget) {
+            snprintf(libjpeg_reason, sizeof(libjpeg_reason), "multi-scan image does not fit in the memory budget");
+            jpeg_destroy_decompress(&cinfo);
+            return NULL;
+        }
+        cinfo.mem->max_memory_to_use = mem_budget;
+    }
+
+    unsigned int longer = cinfo.image_width > cinfo.image_height ? cinfo.image_width : cinfo.image_height;
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = 1;
+    while (target_side > 0 && cinfo.scale_denom < 8 &&
+           (longer + cinfo.scale_denom * 2 - 1) / (cinfo.scale_denom * 2) >= (unsigned int)target_side) {
+        cinfo.scale_denom *= 2;
+    }
+
+#ifdef JCS_EXTENSIONS
+    cinfo.out_color_space = JCS_EXT_RGBA;
+#else
+    cinfo.out_color_space = JCS_RGB;
+#endif
+    jpeg_start_decompress(&cinfo);
+
+    size_t stride = (size_t)cinfo.output_width * 4;
+    if (fn) {
+        row = malloc(stride);
+        if (!row) longjmp(err.jump, 1);
+    } else {
+        image = malloc(stride * cinfo.output_height);
+        if (!image) longjmp(err.jump, 1);
+    }
+
+    while (cinfo.output_scanline < cinfo.output_height) {
+        int y = cinfo.output_scanline;
+        unsigned char *dst = fn ? row : image + stride * y;
+        JSAMPROW rows[1] = { dst };
+        jpeg_read_scanlines(&cinfo, rows, 1);
+#ifndef JCS_EXTENSIONS
+        /* Expand RGB to RGBA from the back so it works in place. */
+        for (int x = cinfo.output_width - 1; x >= 0; x--) {
+            dst[x * 4 + 3] = 255;
+            dst[x * 4 + 2] = dst[x * 3 + 2];
+            dst[x * 4 + 1] = dst[x * 3 + 1];
+            dst[x * 4 + 0] = dst[x * 3 + 0];
+        }
+#endif
+        if (fn) fn(user, 0, dst, cinfo.output_width, y);
+    }
+
+    *width = cinfo.output_width;
+    *height = cinfo.output_height;
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    free(row);
+    *ok = true;
+    return image;
+}
+
+static unsigned char *libjpeg_decode_full(const unsigned char *buffer, size_t len, int *width, int *height) {
+    bool ok;
+    return libjpeg_decode(buffer, len, 0, 0, width, height, NULL, NULL, &ok);
+}
+
+static unsigned char *libjpeg_decode_scaled(const unsigned char *buffer, size_t len, int target_side,
+                                            int *width, int *height) {
+    bool ok;
+    return libjpeg_decode(buffer, len, target_side, 0, width, height, NULL, NULL, &ok);
+}
+
+static bool libjpeg_decode_rows(const unsigned char *buffer, size_t len, size_t mem_budget,
+                                int *width, int *height, decoder_row_fn fn, void *user) {
+    bool ok;
+    libjpeg_decode(buffer, len, 0, mem_budget, width, height, fn, user, &ok);
+    return ok;
+}
+
+static void libjpeg_free_image(unsigned char *image) {
+    free(image);
+}
+
+static const char *libjpeg_failure_reason(void) {
+    return libjpeg_reason;
+}
+
+const decoder_t decoder_libjpeg = {
+    .name           = "libjpeg",
+    .probe          = libjpeg_probe,
+    .info           = libjpeg_info,
+    .decode_full    = libjpeg_decode_full,
+    .decode_scaled  = libjpeg_decode_scaled,
+    .decode_rows    = libjpeg_decode_rows,
+    .free_image     = libjpeg_free_image,
+    .failure_reason = libjpeg_failure_reason,
+};
+
+#endif /* HAVE_LIBJPEG */
@@ -0,0 +1,86 @@
+#ifdef HAVE_LIBPNG
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <png.h>
+
+#include "decoder.h"
+
+/* libpng backend through its simplified API, handy for the PNG flavours
+ * the pipelined stb path does not stream (interlaced, 16-bit). */
+
+static _Thread_local char libpng_reason[64];
+
+static bool libpng_probe(format_e format) {
+    return format == FORMAT_PNG;
+}
+
+static bool libpng_begin(png_image *image, const unsigned char *buffer, size_t len) {
+    memset(image, 0, sizeof(*image));
+    image->version = PNG_IMAGE_VERSION;
+    if (png_image_begin_read_from_memory(image, buffer, len)) return true;
+    snprintf(libpng_reason, sizeof(libpng_reason), "%s", image->message);
+    png_image_free(image);
+    return false;
+}
+
+static bool libpng_info(const unsigned char *buffer, size_t len, int *width, int *height) {
+    png_image image;
+    if (!libpng_begin(&image, buffer, len)) return false;
+    *width = image.width;
+    *height = image.height;
+    png_image_free(&image);
+    return true;
+}
+
+static unsigned char *libpng_decode_full(const unsigned char *buffer, size_t len, int *width, int *height) {
+    png_image image;
+    if (!libpng_begin(&image, buffer, len)) return NULL;
+
+    image.format = PNG_FORMAT_RGBA;
+    unsigned char *pixels = malloc(PNG_IMAGE_SIZE(image));
+    if (!pixels) {
+        strcpy(libpng_reason, "Out of memory");
+        png_image_free(&image);
+        return NULL;
+    }
+    if (!png_image_finish_read(&image, NULL, pixels, 0, NULL)) {
+        snprintf(libpng_reason, sizeof(libpng_reason), "%s", image.message);
+        png_image_free(&image);
+        free(pixels);
+        return NULL;
+    }
+
+    *width = image.width;
+    *height = image.height;
+    return pixels;
+}
+
+static unsigned char *libpng_decode_scaled(const unsigned char *buffer, size_t len, int target_side,
+                                           int *width, int *height) {
+    unsigned char *image = libpng_decode_full(buffer, len, width, height);
+    if (!image) return NULL;
+    return decoder_downscale(image, width, height, target_side);
+}
+
+static void libpng_free_image(unsigned char *image) {
+    free(image);
+}
+
+static const char *libpng_failure_reason(void) {
+    return libpng_reason;
+}
+
+const decoder_t decoder_libpng = {
+    .name           = "libpng",
+    .probe          = libpng_probe,
+    .info           = libpng_info,
+    .decode_full    = libpng_decode_full,
+    .decode_scaled  = libpng_decode_scaled,
+    .decode_rows    = NULL,
+    .free_image     = libpng_free_image,
+    .failure_reason = libpng_failure_reason,
+};
+
+#endif /* HAVE_LIBPNG */
@@ -0,0 +1,316 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "engine.h"
+#include "color_lut.h"
+#include "filter.h"
+#include "config.h"
+
+/* -- Registry -- */
+
+static const engine_t *engines[] = {
+    &engine_frequency,
+    &engine_kmeans,
+    &engine_median_cut,
+    &engine_octree,
+    &engine_wu,
+    &engine_hsv,
+    &engine_hue_peak,
+};
+
+#define ENGINE_COUNT (sizeof(engines) / sizeof(engines[0]))
+
+size_t engine_count(void) {
+    return ENGINE_COUNT;
+}
+
+const engine_t *engine_get(size_t index) {
+    return index < ENGINE_COUNT ? engines[index] : NULL;
+}
+
+const engine_t *engine_find(const char *name) {
+    for (size_t i = 0; i < ENGINE_COUNT; i++) {
+        if (strcmp(engines[i]->name, name) == 0) return engines[i];
+    }
+    return NULL;
+}
+
+/* -- Accents -- */
+
+static hsv_filter_t limits_filter;
+static engine_limits_t limits;
+static bool limits_ready = false;
+static bool limits_set = false;
+
+engine_limits_t engine_limits(void) {
+    if (!limits_set) return (engine_limits_t){ min_lightness, max_lightness, min_saturation, max_saturation };
+    return limits;
+}
+
+void engine_set_limits(engine_limits_t new_limits) {
+    limits = new_limits;
+    limits_set = true;
+    hsv_filter_init(&limits_filter, limits.min_v, limits.max_v, limits.min_s, limits.max_s);
+    limits_ready = true;
+}
+
+void engine_reset_limits(void) {
+    limits_set = false;
+    limits_ready = false;
+}
+
+bool engine_limits_default(void) {
+    return !limits_set;
+}
+
+bool engine_accepts(rgb_t rgb) {
+    if (!limits_ready) {
+        engine_limits_t current = engine_limits();
+        hsv_filter_init(&limits_filter, current.min_v, current.max_v, current.min_s, current.max_s);
+        limits_ready = true;
+    }
+    if (limits_set) return hsv_filter_accepts(&limits_filter, rgb);
+    /* Most cells of the table decide alone, the rest straddle a threshold
+     * and need the exact test. */
+    uint16_t lut = color_lut_lookup(rgb);
+    return (lut & LUT_UNIFORM) ? (lut & LUT_ACCENT) == LUT_ACCENT : hsv_filter_accepts(&limits_filter, rgb);
+}
+
+static uint64_t seed = ENGINE_DEFAULT_SEED;
+
+uint64_t engine_seed(void) {
+    return seed;
+}
+
+void engine_set_seed(uint64_t new_seed) {
+    seed = new_seed;
+}
+
+/* -- Further accents -- */
+
+static size_t pool_slot(rgb_t rgb) {
+    uint8_t r = rgb >> 16, g = rgb >> 8, b = rgb;
+    uint8_t max = r > g ? (r > b ? r : b) : (g > b ? g : b);
+    uint32_t hue = color_lut_lookup(rgb) >> LUT_HUE_SHIFT;
+    return (hue >> 2) * 4 + (max >> 6);
+}
+
+void engine_offer(accents_t *accents, pair_t color) {
+    pair_t *slot = &accents->pool[pool_slot(color.first)];
+    if (color.second > slot->second || (color.second == slot->second && color.first < slot->first)) {
+        *slot = color;
+    }
+}
+
+/* The pool as structure of arrays, padded to ACCENT_POOL so the distance
+ * update below has a fixed trip count and gets vectorized. */
+typedef struct {
+    float L[ACCENT_POOL], a[ACCENT_POOL], b[ACCENT_POOL];
+    float weight[ACCENT_POOL];
+    float nearest[ACCENT_POOL];
+} pool_points_t;
+
+static void pool_nearest(pool_points_t *points, oklab_t picked) {
+    for (size_t i = 0; i < ACCENT_POOL; i++) {
+        float dL = points->L[i] - picked.L, da = points->a[i] - picked.a, db = points->b[i] - picked.b;
+        float d2 = dL * dL + da * da + db * db;
+        points->nearest[i] = d2 < points->nearest[i] ? d2 : points->nearest[i];
+    }
+}
+
+size_t engine_more_accents(const accents_t *accents, size_t count, rgb_t *out) {
+    if (!accents->found || count == 0) return 0;
+    size_t found = 0;
+    out[found++] = accents->first.first;
+    if (count > 1 && accents->second.second) out[found++] = accents->second.first;
+    if (found == count) return found;
+
+    pool_points_t points;
+    rgb_t rgb[ACCENT_POOL];
+    for (size_t i = 0; i < ACCENT_POOL; i++) {
+        rgb[i] = accents->pool[i].first;
+        points.weight[i] = (float)accents->pool[i].second;
+        points.nearest[i] = INFINITY;
+    }
+    rgb_to_oklab_n(rgb, points.L, points.a, points.b, ACCENT_POOL);
+    for (size_t i = 0; i < found; i++) pool_nearest(&points, rgb_to_oklab(out[i]));
+
+    float min_dist2 = second_color_oklab_diff * second_color_oklab_diff;
+    while (found < count) {
+        size_t best = ACCENT_POOL;
+        float best_score = 0;
+        for (size_t i = 0; i < ACCENT_POOL; i++) {
+            if (points.weight[i] == 0 || points.nearest[i] < min_dist2) continue;
+            float score = points.weight[i] * points.nearest[i];
+            /* Ties go to the lower rgb. */
+            if (best == ACCENT_POOL || score > best_score || (score == best_score && rgb[i] < rgb[best])) {
+                best = i;
+                best_score = score;
+            }
+        }
+        if (best == ACCENT_POOL) break;
+        out[found++] = rgb[best];
+        pool_nearest(&points, (oklab_t){ points.L[best], points.a[best], points.b[best] });
+    }
+    return found;
+}
+
+static pair_t swatch_pair(swatch_t swatch) {
+    return (pair_t){ swatch.rgb, swatch.weight > UINT32_MAX ? UINT32_MAX : (uint32_t)swatch.weight };
+}
+
+void engine_pick_swatches(const swatch_t *swatches, size_t count, bool monochrome, accents_t *out) {
+    *out = (accents_t){0};
+    if (count == 0) return;
+    out->most_used = swatch_pair(swatches[0]);
+
+    for (size_t i = 0; i < count; i++) {
+        if (engine_accepts(swatches[i].rgb)) engine_offer(out, swatch_pair(swatches[i]));
+    }
+
+    size_t first = 0;
+    while (first < count && !engine_accepts(swatches[first].rgb)) first++;
+    if (first == count) return;
+    out->first = swatch_pair(swatches[first]);
+    out->found = true;
+    if (monochrome) return;
+
+    oklab_t first_lab = rgb_to_oklab(swatches[first].rgb);
+    float min_dist2 = second_color_oklab_diff * second_color_oklab_diff;
+    for (size_t i = first + 1; i < count; i++) {
+        if (!engine_accepts(swatches[i].rgb)) continue;
+        if (color_oklab_distance2(rgb_to_oklab(swatches[i].rgb), first_lab) >= min_dist2) {
+            out->second = swatch_pair(swatches[i]);
+            return;
+        }
+    }
+}
+
+static int compare_swatches(const void *a, const void *b) {
+    const swatch_t *x = a, *y = b;
+    if (x->weight != y->weight) return x->weight > y->weight ? -1 : 1;
+    return (x->rgb > y->rgb) - (x->rgb < y->rgb);
+}
+
+void engine_sort_swatches(swatch_t *swatches, size_t count) {
+    qsort(swatches, count, sizeof(swatch_t), compare_swatches);
+}
+
+/* -- Distinct colors -- */
+
+static bool flush_batch(engine_batch_t *batch, unsigned convert, engine_batch_fn fn, void *user) {
+    if (convert & ENGINE_BATCH_HSV) rgb_to_hsv_n(batch->rgb, batch->h, batch->s, batch->v, batch->count);
+    if (convert & ENGINE_BATCH_OKLAB) rgb_to_oklab_n(batch->rgb, batch->L, batch->a, batch->b, batch->count);
+    bool ok = fn(user, batch);
+    batch->count = 0;
+    return ok;
+}
+
+bool engine_stream_batches(color_stream_t *colors, unsigned convert, bool accepted_only, pair_t *most_used,
+                           engine_batch_fn fn, void *user) {
+    engine_batch_t *batch = malloc(sizeof(engine_batch_t));
+    if (!batch) {
+        fprintf(stderr, "ERROR: Out of memory!\n");
+        return false;
+    }
+    batch->count = 0;
+
+    bool ok = true;
+    pair_t entry;
+    while (ok && color_stream_next(colors, &entry)) {
+        if (most_used && entry.second > most_used->second) *most_used = entry;
+        if (accepted_only && !engine_accepts(entry.first)) continue;
+        batch->rgb[batch->count] = entry.first;
+        batch->pixels[batch->count++] = entry.second;
+        if (batch->count == ENGINE_BATCH) ok = flush_batch(batch, convert, fn, user);
+    }
+    if (ok && batch->count > 0) ok = flush_batch(batch, convert, fn, user);
+    free(batch);
+    return ok;
+}
+
+#define FOLD_BITS  6
+#define FOLD_BOXES (1u << (3 * FOLD_BITS))
+
+typedef struct {
+    uint64_t r, g, b, weight;
+} fold_box_t;
+
+static size_t fold_index(rgb_t rgb) {
+    uint32_t shift = 8 - FOLD_BITS, mask = (1u << FOLD_BITS) - 1;
+    return (((rgb >> (16 + shift)) & mask) << (2 * FOLD_BITS)) |
+           (((rgb >> (8 + shift)) & mask) << FOLD_BITS) |
+           ((rgb >> shift) & mask);
+}
+
+static void fold_add(fold_box_t *boxes, rgb_t rgb, uint64_t weight) {
+    fold_box_t *box = &boxes[fold_index(rgb)];
+    box->r += ((rgb >> 16) & 0xFF) * weight;
+    box->g += ((rgb >> 8) & 0xFF) * weight;
+    box->b += (rgb & 0xFF) * weight;
+    box->weight += weight;
+}
+
+static bool push_color(engine_colors_t *out, size_t *cap, rgb_t rgb, uint64_t weight) {
+    if (out->count == *cap) {
+        size_t grown = *cap ? *cap * 2 : 4096;
+        rgb_t *rgbs = realloc(out->rgb, grown * sizeof(rgb_t));
+        if (rgbs) out->rgb = rgbs;
+        uint64_t *weights = realloc(out->weight, grown * sizeof(uint64_t));
+        if (weights) out->weight = weights;
+        if (!rgbs || !weights) return false;
+        *cap = grown;
+    }
+    out->rgb[out->count] = rgb;
+    out->weight[out->count] = weight;
+    out->count++;
+    return true;
+}
+
+bool engine_collect(color_stream_t *colors, size_t max_colors, engine_colors_t *out) {
+    *out = (engine_colors_t){0};
+    size_t cap = 0;
+    fold_box_t *boxes = NULL;
+
+    bool ok = true;
+    pair_t entry;
+    while (ok && color_stream_next(colors, &entry)) {
+        if (boxes) {
+            fold_add(boxes, entry.first, entry.second);
+        } else if (out->count < max_colors) {
+            ok = push_color(out, &cap, entry.first, entry.second);
+        } else {
+            boxes = calloc(FOLD_BOXES, sizeof(fold_box_t));
+            ok = boxes != NULL;
+            for (size_t i = 0; ok && i < out->count; i++) fold_add(boxes, out->rgb[i], out->weight[i]);
+            if (ok) fold_add(boxes, entry.first, entry.second);
+        }
+    }
+
+    if (ok && boxes) {
+        out->count = 0;
+        for (size_t i = 0; ok && i < FOLD_BOXES; i++) {
+            const fold_box_t *box = &boxes[i];
+            if (!box->weight) continue;
+            uint64_t half = box->weight / 2;
+            rgb_t rgb = (rgb_t)((box->r + half) / box->weight) << 16 |
+                        (rgb_t)((box->g + half) / box->weight) << 8 |
+                        (rgb_t)((box->b + half) / box->weight);
+            ok = push_color(out, &cap, rgb, box->weight);
+        }
+    }
+    free(boxes);
+
+    if (!ok) {
+        fprintf(stderr, "ERROR: Out of memory!\n");
+        engine_colors_free(out);
+    }
+    return ok;
+}
+
+void engine_colors_free(engine_colors_t *colors) {
+    free(colors->rgb);
+    free(colors->weight);
+    *colors = (engine_colors_t){0};
+}
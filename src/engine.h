@@ -0,0 +1,163 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "helper.h"
+#include "histogram.h"
+
+/* Most accents a palette can list (--accents). The ones after the second
+ * are picked among the heaviest accepted color of each of 64 hue x 4
+ * value slots, so the candidates cover the image rather than crowd
+ * around its main color. */
+#define ACCENTS_MAX 16
+#define ACCENT_POOL 256
+
+/* The two accents the palette is built from, as (rgb, pixel count). */
+typedef struct {
+    pair_t first;
+    pair_t second;
+    /* The most used color whatever the criteria, for the monochrome
+     * fallback when no color qualifies as an accent. */
+    pair_t most_used;
+    bool found;
+    /* Per slot, the heaviest accepted color the engine offered (empty at
+     * a count of 0), see engine_offer() and engine_more_accents(). */
+    pair_t pool[ACCENT_POOL];
+} accents_t;
+
+/* A representative color and how many pixels it stands for. */
+typedef struct {
+    rgb_t rgb;
+    uint64_t weight;
+} swatch_t;
+
+/* The accent value / saturation window, the one of config.h unless it
+ * was set at runtime (--lightness, --saturation). */
+typedef struct {
+    float min_v, max_v, min_s, max_s;
+} engine_limits_t;
+
+/* A palette engine picks the accents, either from the distinct colors of
+ * the image (`pick`) or straight from its pixels (`begin` and the rest).
+ * With both, the pixels are used unless memory is capped (--max-mem).
+ * With `monochrome` only the first accent is needed. Failures (out of
+ * memory) return false having printed why; finding no accent is not a
+ * failure.
+ *
+ * - pick: reads `colors` to the end, may rewind it and read it again.
+ * - pick_windows: the same for each of `count` windows, from one read of
+ *   `colors`, into `out[i]` for `limits[i]` rather than engine_limits().
+ *   Only for engines that answer a window without reading the colors
+ *   again. May be NULL.
+ * - begin: a state for `workers` threads, NULL when out of memory.
+ * - add_rgba: may run on every worker at once, each with its own index.
+ * - rescan: called once all the pixels were added, true to have every one
+ *   of them added again (the image is then held in memory). May be NULL.
+ * - finish: the accents from everything added so far.
+ * - end: frees the state. */
+typedef struct {
+    const char *name;
+    bool (*pick)(color_stream_t *colors, bool monochrome, accents_t *out);
+    bool (*pick_windows)(color_stream_t *colors, bool monochrome, const engine_limits_t *limits, size_t count,
+                         accents_t *out);
+
+    void *(*begin)(size_t workers);
+    void (*add_rgba)(void *state, size_t worker, const uint8_t *rgba, size_t count);
+    bool (*rescan)(void *state);
+    bool (*finish)(void *state, bool monochrome, accents_t *out);
+    void (*end)(void *state);
+} engine_t;
+
+/* The first one is the default. */
+size_t engine_count(void);
+const engine_t *engine_get(size_t index);
+const engine_t *engine_find(const char *name);
+
+extern const engine_t engine_frequency;
+extern const engine_t engine_kmeans;
+extern const engine_t engine_median_cut;
+extern const engine_t engine_octree;
+extern const engine_t engine_wu;
+extern const engine_t engine_hsv;
+extern const engine_t engine_hue_peak;
+
+/* -- For engines -- */
+
+engine_limits_t engine_limits(void);
+/* Between engine runs, never during one. The generated color table no longer applies
+ * then, every color takes the exact test. */
+void engine_set_limits(engine_limits_t limits);
+/* Back to the window of config.h, same rule as engine_set_limits(). */
+void engine_reset_limits(void);
+/* Whether the window is still the one the color table was built for. */
+bool engine_limits_default(void);
+
+/* The seed of the engines that draw random numbers (kmeans), fixed so
+ * that the same image always gives the same palette, --seed changes it. */
+#define ENGINE_DEFAULT_SEED 0x9E3779B97F4A7C15ull
+
+uint64_t engine_seed(void);
+void engine_set_seed(uint64_t seed);
+
+/* Whether `rgb` is within the accent value / saturation window. */
+bool engine_accepts(rgb_t rgb);
+
+/* Offers an accepted color as a candidate for the further accents. The
+ * heaviest of each slot (ties to the lower rgb) is kept whatever the order
+ * they come in. */
+void engine_offer(accents_t *accents, pair_t color);
+
+/* Fills `out` with `count` accents: the first two, then greedily the
+ * pool color with the largest pixel count times squared OKLab distance to
+ * the nearest accent so far, among those at least second_color_oklab_diff
+ * from all of them. Returns how many were found, at most `count`. */
+size_t engine_more_accents(const accents_t *accents, size_t count, rgb_t *out);
+
+/* Accents from swatches sorted heaviest first: the heaviest accepted one,
+ * then the heaviest accepted one far enough from it in OKLab. */
+void engine_pick_swatches(const swatch_t *swatches, size_t count, bool monochrome, accents_t *out);
+
+/* The distinct colors of a stream a batch at a time, with their HSV and
+ * OKLab from the vectorized kernels when asked for (ENGINE_BATCH_HSV,
+ * ENGINE_BATCH_OKLAB). Batches keep the rgb order of the stream. */
+#define ENGINE_BATCH       1024
+#define ENGINE_BATCH_HSV   1u
+#define ENGINE_BATCH_OKLAB 2u
+
+typedef struct {
+    size_t count;
+    rgb_t rgb[ENGINE_BATCH];
+    uint32_t pixels[ENGINE_BATCH];
+    float h[ENGINE_BATCH], s[ENGINE_BATCH], v[ENGINE_BATCH];
+    float L[ENGINE_BATCH], a[ENGINE_BATCH], b[ENGINE_BATCH];
+} engine_batch_t;
+
+/* False to stop, having printed why. */
+typedef bool (*engine_batch_fn)(void *user, const engine_batch_t *batch);
+
+/* Reads `colors` to the end and hands `fn` every color, or only the ones
+ * engine_accepts() when `accepted_only`. `most_used` (may be NULL) gets
+ * the most used color of the whole stream, ties to the lower rgb. The
+ * batch is allocated per call, so picks can run at the same time. */
+bool engine_stream_batches(color_stream_t *colors, unsigned convert, bool accepted_only, pair_t *most_used,
+                           engine_batch_fn fn, void *user);
+
+/* Sorts heaviest first, ties by rgb so the order is stable. */
+void engine_sort_swatches(swatch_t *swatches, size_t count);
+
+/* The distinct colors and their counts. Past `max_colors` they are folded
+ * into 6 bits per channel boxes, each at the weighted mean of its colors,
+ * so the point count (and memory) stays bounded. */
+typedef struct {
+    rgb_t *rgb;
+    uint64_t *weight;
+    size_t count;
+} engine_colors_t;
+
+bool engine_collect(color_stream_t *colors, size_t max_colors, engine_colors_t *out);
+void engine_colors_free(engine_colors_t *colors);
+
+#endif /* ENGINE_H */
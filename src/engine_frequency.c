@@ -0,0 +1,353 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "engine.h"
+#include "candidates.h"
+#include "color_lut.h"
+#include "config.h"
+
+/* The most used accepted color, then the most used one less used than it
+ * and far enough from it in OKLab.
+ *
+ * Picks from the finished histogram rather than while scanning, so the
+ * result does not depend on the order the pixels were counted in. The
+ * value / saturation window is tested on integers and only the colors
+ * that pass go to OKLab and HSV, a batch at a time with the vectorized
+ * kernels, into the hue index the second accent is looked up in. When
+ * the index can not tell, the stream is read once more for it. */
+typedef struct {
+    accents_t *out;
+    candidate_index_t index;
+} frequency_t;
+
+static bool frequency_batch(void *user, const engine_batch_t *batch) {
+    frequency_t *pick = user;
+    accents_t *out = pick->out;
+    for (size_t i = 0; i < batch->count; i++) {
+        pair_t entry = { batch->rgb[i], batch->pixels[i] };
+        engine_offer(out, entry);
+        if (entry.second > out->first.second) {
+            out->found = true;
+            out->first = entry;
+        }
+        candidate_t candidate = { entry.first, entry.second, { batch->L[i], batch->a[i], batch->b[i] } };
+        candidate_index_add(&pick->index, candidate_bin(batch->h[i]), candidate);
+    }
+    return true;
+}
+
+/* The second accent from every color of the stream, the slow way. Colors
+ * come in increasing rgb order, so the first of a count wins its ties. */
+static bool frequency_rescan(color_stream_t *colors, const accents_t *out, pair_t *second) {
+    if (!color_stream_rewind(colors)) return false;
+
+    oklab_t first_lab = rgb_to_oklab(out->first.first);
+    float min_dist2 = second_color_oklab_diff * second_color_oklab_diff;
+    *second = (pair_t){0};
+    pair_t entry;
+    while (color_stream_next(colors, &entry)) {
+        if (entry.second >= out->first.second || entry.second <= second->second) continue;
+        if (!engine_accepts(entry.first)) continue;
+        if (color_oklab_distance2(rgb_to_oklab(entry.first), first_lab) >= min_dist2) *second = entry;
+    }
+    return !colors->failed;
+}
+
+static bool frequency_pick(color_stream_t *colors, bool monochrome, accents_t *out) {
+    *out = (accents_t){0};
+
+    frequency_t pick = { out, {0} };
+    if (!candidate_index_init(&pick.index)) {
+        fprintf(stderr, "ERROR: Out of memory!\n");
+        return false;
+    }
+    if (!engine_stream_batches(colors, ENGINE_BATCH_HSV | ENGINE_BATCH_OKLAB, true, &out->most_used,
+                               frequency_batch, &pick)) {
+        candidate_index_free(&pick.index);
+        return false;
+    }
+
+    candidate_index_finish(&pick.index);
+    bool ok = true;
+    if (!monochrome && out->found) {
+        oklab_t first_lab = rgb_to_oklab(out->first.first);
+        float min_dist2 = second_color_oklab_diff * second_color_oklab_diff;
+        const candidate_t *second;
+        if (candidate_index_query(&pick.index, out->first.second, first_lab, min_dist2, &second)) {
+            if (second) out->second = (pair_t){ second->rgb, second->count };
+        } else {
+            ok = frequency_rescan(colors, out, &out->second);
+        }
+    }
+
+    candidate_index_free(&pick.index);
+    return ok;
+}
+
+/* -- Coarse to fine -- */
+
+/* The same choice straight from the pixels, without the 64 MB dense
+ * histogram. The first pass only counts 4 bits per channel cubes (4096
+ * bins, fits L1). Each further pass counts the exact colors of the few
+ * cubes that can still hold a better answer, the heaviest first: a cube
+ * whose total is below the best count found so far can not, and one with
+ * no accepted cell in the color LUT never holds an accent. Usually a
+ * second pass settles it. The answers, tie breaks included, are the ones
+ * frequency_pick() gives. */
+
+#define COARSE_BINS   4096
+#define BIN_COLORS    4096
+#define COARSE_BATCH  64
+#define COARSE_BLOCK  256
+
+typedef struct {
+    rgb_t rgb;
+    uint32_t count;
+    bool accepted;
+} exact_t;
+
+typedef struct {
+    size_t workers;
+    bool fine;
+    uint64_t *coarse;
+    uint32_t *exact;
+
+    uint64_t totals[COARSE_BINS];
+    bool possible[COARSE_BINS];
+    bool resolved[COARSE_BINS];
+    int16_t slot[COARSE_BINS];
+    uint16_t batch[COARSE_BINS];
+    size_t batch_count, batch_cap;
+
+    /* The accepted colors counted so far, and the most used other one. */
+    exact_t *colors;
+    size_t color_count, color_cap;
+    exact_t most_rejected;
+    bool failed;
+} coarse_t;
+
+static uint32_t coarse_bin(rgb_t rgb) {
+    return ((rgb >> 12) & 0xF00) | ((rgb >> 8) & 0x0F0) | ((rgb >> 4) & 0x00F);
+}
+
+static uint32_t coarse_fine(rgb_t rgb) {
+    return ((rgb >> 8) & 0xF00) | ((rgb >> 4) & 0x0F0) | (rgb & 0x00F);
+}
+
+static rgb_t coarse_rgb(uint32_t bin, uint32_t fine) {
+    return ((bin & 0xF00) << 12) | ((fine & 0xF00) << 8) | ((bin & 0x0F0) << 8) |
+           ((fine & 0x0F0) << 4) | ((bin & 0x00F) << 4) | (fine & 0x00F);
+}
+
+/* "a wins over b" the way the stream picks: more pixels, then lower rgb. */
+static bool exact_beats(const exact_t *a, const exact_t *b) {
+    return !b || a->count > b->count || (a->count == b->count && a->rgb < b->rgb);
+}
+
+static void *coarse_begin(size_t workers) {
+    coarse_t *state = calloc(1, sizeof(coarse_t));
+    if (!state) return NULL;
+    state->workers = workers;
+    state->coarse = calloc(workers * COARSE_BINS, sizeof(uint64_t));
+    if (!state->coarse) {
+        free(state);
+        return NULL;
+    }
+    return state;
+}
+
+static void coarse_add_rgba(void *user, size_t worker, const uint8_t *rgba, size_t count) {
+    coarse_t *state = user;
+    rgb_t block[COARSE_BLOCK];
+    uint64_t *coarse = state->coarse + worker * COARSE_BINS;
+    uint32_t *exact = state->exact + worker * state->batch_cap * BIN_COLORS;
+    for (size_t start = 0; start < count; start += COARSE_BLOCK) {
+        size_t n = count - start < COARSE_BLOCK ? count - start : COARSE_BLOCK;
+        unpack_rgba(rgba + start * 4, block, n);
+        if (!state->fine) {
+            for (size_t i = 0; i < n; i++) coarse[coarse_bin(block[i])]++;
+            continue;
+        }
+        for (size_t i = 0; i < n; i++) {
+            int slot = state->slot[coarse_bin(block[i])];
+            if (slot >= 0) exact[slot * BIN_COLORS + coarse_fine(block[i])]++;
+        }
+    }
+}
+
+/* Whether any of the 8 LUT cells of a cube is not uniformly rejected. */
+static bool coarse_possible(uint32_t bin) {
+    if (!engine_limits_default()) return true;
+    for (uint32_t cell = 0; cell < 8; cell++) {
+        rgb_t rgb = coarse_rgb(bin, ((cell & 4) << 7) | ((cell & 2) << 4) | ((cell & 1) << 3));
+        uint16_t lut = color_lut_lookup(rgb);
+        if (!(lut & LUT_UNIFORM) || (lut & LUT_ACCENT) == LUT_ACCENT) return true;
+    }
+    return false;
+}
+
+static bool coarse_push(coarse_t *state, rgb_t rgb, uint32_t count) {
+    exact_t color = { rgb, count, engine_accepts(rgb) };
+    if (!color.accepted) {
+        if (exact_beats(&color, state->most_rejected.count ? &state->most_rejected : NULL)) {
+            state->most_rejected = color;
+        }
+        return true;
+    }
+    if (state->color_count == state->color_cap) {
+        size_t cap = state->color_cap ? state->color_cap * 2 : 4096;
+        exact_t *grown = realloc(state->colors, cap * sizeof(exact_t));
+        if (!grown) return false;
+        state->colors = grown;
+        state->color_cap = cap;
+    }
+    state->colors[state->color_count++] = color;
+    return true;
+}
+
+/* The three answers among the colors counted so far. */
+static void coarse_answers(const coarse_t *state, const exact_t **first, const exact_t **second,
+                           const exact_t **most) {
+    *first = *second = NULL;
+    *most = state->most_rejected.count ? &state->most_rejected : NULL;
+    for (size_t i = 0; i < state->color_count; i++) {
+        const exact_t *c = &state->colors[i];
+        if (exact_beats(c, *most)) *most = c;
+        if (exact_beats(c, *first)) *first = c;
+    }
+    if (!*first) return;
+
+    oklab_t first_lab = rgb_to_oklab((*first)->rgb);
+    float min_dist2 = second_color_oklab_diff * second_color_oklab_diff;
+    for (size_t i = 0; i < state->color_count; i++) {
+        const exact_t *c = &state->colors[i];
+        if (c->count >= (*first)->count || !exact_beats(c, *second)) continue;
+        if (color_oklab_distance2(rgb_to_oklab(c->rgb), first_lab) >= min_dist2) *second = c;
+    }
+}
+
+typedef struct {
+    uint64_t total;
+    uint32_t bin;
+} bin_total_t;
+
+static int compare_bins(const void *a, const void *b) {
+    const bin_total_t *x = a, *y = b;
+    if (x->total != y->total) return x->total > y->total ? -1 : 1;
+    return (x->bin > y->bin) - (x->bin < y->bin);
+}
+
+static bool coarse_rescan(void *user) {
+    coarse_t *state = user;
+    if (state->failed) return false;
+
+    if (!state->fine) {
+        for (size_t w = 0; w < state->workers; w++) {
+            for (uint32_t bin = 0; bin < COARSE_BINS; bin++) state->totals[bin] += state->coarse[w * COARSE_BINS + bin];
+        }
+        for (uint32_t bin = 0; bin < COARSE_BINS; bin++) state->possible[bin] = coarse_possible(bin);
+        state->fine = true;
+        memset(state->slot, 0xFF, sizeof(state->slot));
+    } else {
+        for (size_t s = 0; s < state->batch_count; s++) {
+            uint32_t bin = state->batch[s];
+            for (uint32_t fine = 0; fine < BIN_COLORS; fine++) {
+                uint32_t count = 0;
+                for (size_t w = 0; w < state->workers; w++) {
+                    count += state->exact[(w * state->batch_cap + s) * BIN_COLORS + fine];
+                }
+                if (count && !coarse_push(state, coarse_rgb(bin, fine), count)) {
+                    state->failed = true;
+                    return false;
+                }
+            }
+            state->resolved[bin] = true;
+            state->slot[bin] = -1;
+        }
+    }
+
+    /* Cubes that may still hold something better than the answers so far,
+     * the second accent only once the first one is settled. */
+    const exact_t *first, *second, *most;
+    coarse_answers(state, &first, &second, &most);
+    uint64_t first_min = first ? first->count : 1, most_min = most ? most->count : 1;
+    bool first_settled = true;
+    for (uint32_t bin = 0; bin < COARSE_BINS; bin++) {
+        if (!state->resolved[bin] && state->possible[bin] && state->totals[bin] >= first_min) first_settled = false;
+    }
+    uint64_t second_min = second ? second->count : 1;
+
+    bin_total_t needed[COARSE_BINS];
+    size_t needed_count = 0;
+    for (uint32_t bin = 0; bin < COARSE_BINS; bin++) {
+        if (state->resolved[bin] || !state->totals[bin]) continue;
+        uint64_t total = state->totals[bin];
+        bool need = total >= most_min;
+        if (state->possible[bin]) need = need || total >= first_min || (first_settled && total >= second_min);
+        if (need) needed[needed_count++] = (bin_total_t){ total, bin };
+    }
+    if (needed_count == 0) return false;
+
+    /* Each pass takes 4 times more cubes than the last, so a picture where
+     * the bounds prune little (every color used once) still takes only a
+     * few passes; all the workers together stay within the 64 MB of the
+     * dense table. */
+    size_t cap = state->batch_cap ? state->batch_cap * 4 : COARSE_BATCH;
+    size_t max_cap = COARSE_BINS / state->workers;
+    if (cap > max_cap) cap = max_cap > COARSE_BATCH ? max_cap : COARSE_BATCH;
+    if (cap != state->batch_cap) {
+        free(state->exact);
+        state->exact = malloc(state->workers * cap * BIN_COLORS * sizeof(uint32_t));
+        state->batch_cap = cap;
+        if (!state->exact) {
+            state->failed = true;
+            return false;
+        }
+    }
+
+    qsort(needed, needed_count, sizeof(bin_total_t), compare_bins);
+    state->batch_count = needed_count < cap ? needed_count : cap;
+    for (size_t s = 0; s < state->batch_count; s++) {
+        state->batch[s] = needed[s].bin;
+        state->slot[needed[s].bin] = s;
+    }
+    memset(state->exact, 0, state->workers * cap * BIN_COLORS * sizeof(uint32_t));
+    return true;
+}
+
+static bool coarse_finish(void *user, bool monochrome, accents_t *out) {
+    coarse_t *state = user;
+    *out = (accents_t){0};
+    if (state->failed) {
+        fprintf(stderr, "ERROR: Out of memory!\n");
+        return false;
+    }
+
+    const exact_t *first, *second, *most;
+    coarse_answers(state, &first, &second, &most);
+    if (most) out->most_used = (pair_t){ most->rgb, most->count };
+    if (first) {
+        out->first = (pair_t){ first->rgb, first->count };
+        out->found = true;
+    }
+    if (second && !monochrome) out->second = (pair_t){ second->rgb, second->count };
+    return true;
+}
+
+static void coarse_end(void *user) {
+    coarse_t *state = user;
+    free(state->coarse);
+    free(state->exact);
+    free(state->colors);
+    free(state);
+}
+
+const engine_t engine_frequency = {
+    .name     = "frequency",
+    .pick     = frequency_pick,
+    .begin    = coarse_begin,
+    .add_rgba = coarse_add_rgba,
+    .rescan   = coarse_rescan,
+    .finish   = coarse_finish,
+    .end      = coarse_end,
+};
@@ -0,0 +1,27 @@
+#include "engine.h"
+#include "hsv_histogram.h"
+
+/* The accents from the HSV cells rather than from single colors, see
+ * hsv_histogram.h: close shades add up, so a spread out hue can win over
+ * one exact color, and the value / saturation window is applied to the
+ * cells. */
+/* The cells do not depend on the window, one build serves them all. */
+static bool hsv_pick_windows(color_stream_t *colors, bool monochrome, const engine_limits_t *limits, size_t count,
+                             accents_t *out) {
+    hsv_histogram_t hist;
+    if (!hsv_histogram_build(&hist, colors)) return false;
+    for (size_t i = 0; i < count; i++) hsv_histogram_accents(&hist, limits[i], monochrome, &out[i]);
+    hsv_histogram_free(&hist);
+    return true;
+}
+
+static bool hsv_pick(color_stream_t *colors, bool monochrome, accents_t *out) {
+    engine_limits_t limits = engine_limits();
+    return hsv_pick_windows(colors, monochrome, &limits, 1, out);
+}
+
+const engine_t engine_hsv = {
+    .name         = "hsv",
+    .pick         = hsv_pick,
+    .pick_windows = hsv_pick_windows,
+};
@@ -0,0 +1,180 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "engine.h"
+#include "config.h"
+
+/* The accents as the peaks of the hue density rather than single colors.
+ * The accepted colors are counted into 720 hue bins (half a degree), the
+ * circle is smoothed with a gaussian and the peaks are ranked by their
+ * prominence, the height above the highest saddle towards a higher peak.
+ * A broad region of close hues then wins over one exact value used a lot,
+ * and a bump on the side of a larger peak is not taken for a second one.
+ * Each peak is reported as the most used color of the bins around it.
+ * Counting aside, everything is O(bins). */
+
+#define HUE_PEAK_BINS   720
+#define HUE_PEAK_RADIUS 32 /* Kernel taps each side, at least 3 sigma. */
+#define HUE_PEAK_MAX    64
+
+typedef struct {
+    double count[HUE_PEAK_BINS];
+    rgb_t rgb[HUE_PEAK_BINS];
+    uint32_t rgb_count[HUE_PEAK_BINS];
+} hue_bins_count_t;
+
+typedef struct {
+    int bin;
+    float height;
+    float prominence;
+} peak_t;
+
+/* Written as one pass per tap over the padded circle, so the inner loop
+ * runs over contiguous bins and the compiler vectorizes it. */
+static void smooth(const double *count, float *out) {
+    float padded[HUE_PEAK_BINS + 2 * HUE_PEAK_RADIUS];
+    float kernel[2 * HUE_PEAK_RADIUS + 1];
+    float sigma = hue_peak_sigma * HUE_PEAK_BINS;
+    if (sigma > HUE_PEAK_RADIUS / 3.0f) sigma = HUE_PEAK_RADIUS / 3.0f;
+    for (int t = -HUE_PEAK_RADIUS; t <= HUE_PEAK_RADIUS; t++) {
+        kernel[t + HUE_PEAK_RADIUS] = sigma > 0 ? expf(-0.5f * (t / sigma) * (t / sigma)) : (t == 0);
+    }
+
+    for (int i = 0; i < HUE_PEAK_BINS + 2 * HUE_PEAK_RADIUS; i++) {
+        padded[i] = count[(i - HUE_PEAK_RADIUS + HUE_PEAK_BINS) % HUE_PEAK_BINS];
+    }
+    memset(out, 0, HUE_PEAK_BINS * sizeof(float));
+    for (int t = 0; t <= 2 * HUE_PEAK_RADIUS; t++) {
+        float weight = kernel[t];
+        const float *shifted = padded + t;
+        for (int i = 0; i < HUE_PEAK_BINS; i++) out[i] += weight * shifted[i];
+    }
+}
+
+/* Height above the higher of the two lowest points met on the way to a
+ * higher bin, each way round the circle; for the highest peak, above the
+ * lowest bin. Ties go to the lower bin so plateaus count once. */
+static float prominence(const float *density, int bin) {
+    float height = density[bin], base[2];
+    for (int side = 0; side < 2; side++) {
+        int step = side ? 1 : HUE_PEAK_BINS - 1;
+        float lowest = height;
+        for (int i = 1; i < HUE_PEAK_BINS; i++) {
+            int at = (bin + i * step) % HUE_PEAK_BINS;
+            if (density[at] > height || (density[at] == height && at < bin)) break;
+            if (density[at] < lowest) lowest = density[at];
+        }
+        base[side] = lowest;
+    }
+    return height - (base[0] > base[1] ? base[0] : base[1]);
+}
+
+static int compare_peaks(const void *a, const void *b) {
+    const peak_t *x = a, *y = b;
+    if (x->prominence != y->prominence) return x->prominence > y->prominence ? -1 : 1;
+    return (x->bin > y->bin) - (x->bin < y->bin);
+}
+
+/* The most used color within the kernel around `bin`, with the pixels of
+ * those bins as its weight. */
+static pair_t peak_color(const hue_bins_count_t *bins, int bin) {
+    pair_t best = {0};
+    double total = 0;
+    for (int t = -HUE_PEAK_RADIUS; t <= HUE_PEAK_RADIUS; t++) {
+        int at = (bin + t + HUE_PEAK_BINS) % HUE_PEAK_BINS;
+        total += bins->count[at];
+        if (bins->rgb_count[at] > best.second ||
+                (bins->rgb_count[at] == best.second && bins->rgb_count[at] && bins->rgb[at] < best.first)) {
+            best = (pair_t){ bins->rgb[at], bins->rgb_count[at] };
+        }
+    }
+    if (best.second) best.second = total > UINT32_MAX ? UINT32_MAX : (uint32_t)total;
+    return best;
+}
+
+static bool hue_peak_batch(void *user, const engine_batch_t *batch) {
+    hue_bins_count_t *bins = user;
+    for (size_t i = 0; i < batch->count; i++) {
+        int bin = (int)(batch->h[i] * HUE_PEAK_BINS);
+        if (bin >= HUE_PEAK_BINS) bin = HUE_PEAK_BINS - 1;
+        bins->count[bin] += batch->pixels[i];
+        if (batch->pixels[i] > bins->rgb_count[bin]) {
+            bins->rgb[bin] = batch->rgb[i];
+            bins->rgb_count[bin] = batch->pixels[i];
+        }
+    }
+    return true;
+}
+
+static bool hue_peak_pick(color_stream_t *colors, bool monochrome, accents_t *out) {
+    *out = (accents_t){0};
+    hue_bins_count_t *bins = calloc(1, sizeof(hue_bins_count_t));
+    if (!bins) {
+        fprintf(stderr, "ERROR: Out of memory!\n");
+        return false;
+    }
+
+    if (!engine_stream_batches(colors, ENGINE_BATCH_HSV, true, &out->most_used, hue_peak_batch, bins)) {
+        free(bins);
+        return false;
+    }
+
+    float density[HUE_PEAK_BINS];
+    smooth(bins->count, density);
+
+    peak_t peaks[HUE_PEAK_MAX];
+    size_t peak_count = 0;
+    float highest = 0;
+    for (int bin = 0; bin < HUE_PEAK_BINS; bin++) {
+        float left = density[(bin + HUE_PEAK_BINS - 1) % HUE_PEAK_BINS];
+        float right = density[(bin + 1) % HUE_PEAK_BINS];
+        if (density[bin] <= 0 || density[bin] < left || density[bin] < right) continue;
+        /* Plateaus: only their first bin. */
+        if (density[bin] == left) continue;
+        peak_t peak = { bin, density[bin], prominence(density, bin) };
+        if (peak.height > highest) highest = peak.height;
+        if (peak_count < HUE_PEAK_MAX) {
+            peaks[peak_count++] = peak;
+        } else {
+            /* Keep the most prominent ones. */
+            size_t weakest = 0;
+            for (size_t i = 1; i < peak_count; i++) {
+                if (compare_peaks(&peaks[i], &peaks[weakest]) > 0) weakest = i;
+            }
+            if (compare_peaks(&peak, &peaks[weakest]) < 0) peaks[weakest] = peak;
+        }
+    }
+    qsort(peaks, peak_count, sizeof(peak_t), compare_peaks);
+
+    for (size_t i = 0; i < peak_count; i++) {
+        pair_t color = peak_color(bins, peaks[i].bin);
+        if (color.second) engine_offer(out, color);
+    }
+
+    oklab_t first_lab = {0};
+    float min_dist2 = second_color_oklab_diff * second_color_oklab_diff;
+    for (size_t i = 0; i < peak_count; i++) {
+        /* The most prominent peak always stands, the others must stand out. */
+        if (i > 0 && peaks[i].prominence < hue_peak_min_prominence * highest) break;
+        pair_t color = peak_color(bins, peaks[i].bin);
+        if (!color.second) continue;
+        if (!out->found) {
+            out->first = color;
+            out->found = true;
+            first_lab = rgb_to_oklab(color.first);
+            if (monochrome) break;
+        } else if (color_oklab_distance2(rgb_to_oklab(color.first), first_lab) >= min_dist2) {
+            out->second = color;
+            break;
+        }
+    }
+
+    free(bins);
+    return true;
+}
+
+const engine_t engine_hue_peak = {
+    .name = "hue-peak",
+    .pick = hue_peak_pick,
+};
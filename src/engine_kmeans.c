@@ -0,0 +1,216 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "engine.h"
+#include "parallel.h"
+#include "config.h"
+
+/* Weighted k-means in OKLab over the distinct colors, each weighing its
+ * pixel count, seeded with k-means++. The assignment step runs in blocks
+ * on every thread, each block keeping its own sums that are added up in
+ * block order, so the result does not depend on the thread count. A
+ * cluster is reported as its member closest to the centroid, a color
+ * that really is in the image. The draws come from engine_seed(). */
+
+#define KMEANS_MAX_COLORS     (1u << 20)
+#define KMEANS_MAX_K          64
+#define KMEANS_MAX_ITERATIONS 32
+#define KMEANS_BLOCK          16384
+/* Stop once no centroid moves more than this (OKLab distance squared). */
+#define KMEANS_EPSILON        1e-8f
+
+typedef struct {
+    float *L, *a, *b;
+    const uint64_t *weight;
+    size_t count;
+
+    oklab_t centers[KMEANS_MAX_K];
+    size_t k;
+    uint8_t *cluster;
+    /* Per block: L, a, b and weight sums of every cluster. */
+    double *sums;
+    size_t *changed;
+} kmeans_t;
+
+static double next_unit(uint64_t *state) {
+    /* xorshift64*, 53 bits. */
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return ((*state * 0x2545F4914F6CDD1Dull) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static float point_distance2(const kmeans_t *km, size_t i, oklab_t center) {
+    oklab_t p = { km->L[i], km->a[i], km->b[i] };
+    return color_oklab_distance2(p, center);
+}
+
+/* Index where the running sum of `weights` passes `target`. */
+static size_t sample(const double *weights, size_t count, double target) {
+    double sum = 0;
+    for (size_t i = 0; i < count; i++) {
+        sum += weights[i];
+        if (sum > target) return i;
+    }
+    return count - 1;
+}
+
+/* k-means++: each new center is drawn with probability proportional to
+ * weight times squared distance to the nearest center so far. */
+static bool seed_centers(kmeans_t *km, size_t k) {
+    double *d2 = malloc(km->count * sizeof(double));
+    double *p = malloc(km->count * sizeof(double));
+    if (!d2 || !p) {
+        free(d2);
+        free(p);
+        return false;
+    }
+
+    /* xorshift never leaves 0. */
+    uint64_t state = engine_seed() ? engine_seed() : ENGINE_DEFAULT_SEED;
+    double total = 0;
+    for (size_t i = 0; i < km->count; i++) total += km->weight[i];
+    for (size_t i = 0; i < km->count; i++) p[i] = km->weight[i];
+
+    km->k = 0;
+    while (km->k < k && total > 0) {
+        size_t pick = sample(p, km->count, next_unit(&state) * total);
+        oklab_t center = { km->L[pick], km->a[pick], km->b[pick] };
+        km->centers[km->k] = center;
+
+        total = 0;
+        for (size_t i = 0; i < km->count; i++) {
+            double d = point_distance2(km, i, center);
+            if (km->k == 0 || d < d2[i]) d2[i] = d;
+            p[i] = km->weight[i] * d2[i];
+            total += p[i];
+        }
+        km->k++;
+    }
+
+    free(d2);
+    free(p);
+    return true;
+}
+
+static void assign_block(void *ctx, size_t block, size_t worker) {
+    (void)worker;
+    kmeans_t *km = ctx;
+    size_t start = block * KMEANS_BLOCK;
+    size_t end = start + KMEANS_BLOCK < km->count ? start + KMEANS_BLOCK : km->count;
+    double *sums = km->sums + block * km->k * 4;
+    memset(sums, 0, km->k * 4 * sizeof(double));
+
+    size_t changed = 0;
+    for (size_t i = start; i < end; i++) {
+        uint8_t best = 0;
+        float best_d = point_distance2(km, i, km->centers[0]);
+        for (size_t c = 1; c < km->k; c++) {
+            float d = point_distance2(km, i, km->centers[c]);
+            if (d < best_d) {
+                best_d = d;
+                best = c;
+            }
+        }
+        if (best != km->cluster[i]) changed++;
+        km->cluster[i] = best;
+
+        double w = km->weight[i];
+        double *sum = sums + best * 4;
+        sum[0] += w * km->L[i];
+        sum[1] += w * km->a[i];
+        sum[2] += w * km->b[i];
+        sum[3] += w;
+    }
+    km->changed[block] = changed;
+}
+
+/* Returns false when no center moved enough to go on. */
+static bool update_centers(kmeans_t *km, size_t blocks) {
+    size_t changed = 0;
+    for (size_t block = 0; block < blocks; block++) changed += km->changed[block];
+
+    float shift = 0;
+    for (size_t c = 0; c < km->k; c++) {
+        double L = 0, a = 0, b = 0, w = 0;
+        for (size_t block = 0; block < blocks; block++) {
+            const double *sum = km->sums + (block * km->k + c) * 4;
+            L += sum[0];
+            a += sum[1];
+            b += sum[2];
+            w += sum[3];
+        }
+        /* An empty cluster keeps its center. */
+        if (w == 0) continue;
+        oklab_t center = { (float)(L / w), (float)(a / w), (float)(b / w) };
+        float d = color_oklab_distance2(center, km->centers[c]);
+        if (d > shift) shift = d;
+        km->centers[c] = center;
+    }
+    return changed > 0 && shift > KMEANS_EPSILON;
+}
+
+static bool kmeans_pick(color_stream_t *colors, bool monochrome, accents_t *out) {
+    *out = (accents_t){0};
+
+    engine_colors_t points;
+    if (!engine_collect(colors, KMEANS_MAX_COLORS, &points)) return false;
+
+    size_t k = engine_swatches < KMEANS_MAX_K ? engine_swatches : KMEANS_MAX_K;
+    size_t blocks = (points.count + KMEANS_BLOCK - 1) / KMEANS_BLOCK;
+    kmeans_t km = { .weight = points.weight, .count = points.count };
+    km.L = malloc(points.count * sizeof(float));
+    km.a = malloc(points.count * sizeof(float));
+    km.b = malloc(points.count * sizeof(float));
+    km.cluster = malloc(points.count);
+    km.sums = malloc(blocks * k * 4 * sizeof(double));
+    km.changed = malloc(blocks * sizeof(size_t));
+    swatch_t *swatches = calloc(k, sizeof(swatch_t));
+    float *best = malloc(k * sizeof(float));
+
+    bool ok = points.count > 0 && km.L && km.a && km.b && km.cluster && km.sums && km.changed &&
+              swatches && best;
+    if (ok) {
+        rgb_to_oklab_n(points.rgb, km.L, km.a, km.b, points.count);
+        memset(km.cluster, 0xFF, points.count);
+        ok = seed_centers(&km, k);
+    }
+
+    if (ok) {
+        for (int iteration = 0; iteration < KMEANS_MAX_ITERATIONS; iteration++) {
+            parallel_for(blocks, assign_block, &km);
+            if (!update_centers(&km, blocks)) break;
+        }
+
+        for (size_t c = 0; c < km.k; c++) best[c] = -1;
+        for (size_t i = 0; i < points.count; i++) {
+            uint8_t c = km.cluster[i];
+            float d = point_distance2(&km, i, km.centers[c]);
+            if (best[c] < 0 || d < best[c]) {
+                best[c] = d;
+                swatches[c].rgb = points.rgb[i];
+            }
+            swatches[c].weight += points.weight[i];
+        }
+        engine_sort_swatches(swatches, km.k);
+        engine_pick_swatches(swatches, km.k, monochrome, out);
+    } else if (points.count > 0) {
+        fprintf(stderr, "ERROR: Out of memory!\n");
+    }
+
+    free(km.L);
+    free(km.a);
+    free(km.b);
+    free(km.cluster);
+    free(km.sums);
+    free(km.changed);
+    free(swatches);
+    free(best);
+    engine_colors_free(&points);
+    return ok || points.count == 0;
+}
+
+const engine_t engine_kmeans = {
+    .name = "kmeans",
+    .pick = kmeans_pick,
+};
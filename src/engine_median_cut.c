@@ -0,0 +1,145 @@
+#include <stdlib.h>
+
+#include "engine.h"
+#include "config.h"
+
+/* Median cut over the distinct colors: start from the box around all of
+ * them and keep splitting the box with the largest extent times weight,
+ * along its longest axis at the pixel-weighted median, until there are
+ * `engine_swatches` boxes. The median comes from a 256 bin count of the
+ * box along that axis and the split is an in-place partition, so each
+ * round is linear in the colors of the box. A box is reported as the
+ * weighted mean of its colors. */
+
+#define MEDIAN_CUT_MAX_COLORS (1u << 22)
+#define MEDIAN_CUT_MAX_BOXES  256
+
+typedef struct {
+    size_t start, end;
+    uint64_t weight;
+    uint8_t min[3], max[3];
+} box_t;
+
+static uint8_t channel(rgb_t rgb, int axis) {
+    return rgb >> (16 - 8 * axis);
+}
+
+static void box_fit(box_t *box, const engine_colors_t *colors) {
+    box->weight = 0;
+    for (int axis = 0; axis < 3; axis++) {
+        box->min[axis] = 255;
+        box->max[axis] = 0;
+    }
+    for (size_t i = box->start; i < box->end; i++) {
+        for (int axis = 0; axis < 3; axis++) {
+            uint8_t c = channel(colors->rgb[i], axis);
+            if (c < box->min[axis]) box->min[axis] = c;
+            if (c > box->max[axis]) box->max[axis] = c;
+        }
+        box->weight += colors->weight[i];
+    }
+}
+
+static int box_axis(const box_t *box) {
+    int axis = 0;
+    for (int i = 1; i < 3; i++) {
+        if (box->max[i] - box->min[i] > box->max[axis] - box->min[axis]) axis = i;
+    }
+    return axis;
+}
+
+/* Zero for a box of a single color, which can not be split. */
+static double box_priority(const box_t *box) {
+    int axis = box_axis(box);
+    return (double)(box->max[axis] - box->min[axis]) * box->weight;
+}
+
+static void swap_colors(engine_colors_t *colors, size_t i, size_t j) {
+    rgb_t rgb = colors->rgb[i];
+    colors->rgb[i] = colors->rgb[j];
+    colors->rgb[j] = rgb;
+    uint64_t weight = colors->weight[i];
+    colors->weight[i] = colors->weight[j];
+    colors->weight[j] = weight;
+}
+
+static void box_split(box_t *box, box_t *other, engine_colors_t *colors) {
+    int axis = box_axis(box);
+    uint64_t counts[256] = {0};
+    for (size_t i = box->start; i < box->end; i++) {
+        counts[channel(colors->rgb[i], axis)] += colors->weight[i];
+    }
+
+    /* Colors up to the median go left, unless that is all of them. */
+    uint64_t sum = 0;
+    int median = box->min[axis];
+    while (median < box->max[axis] && (sum + counts[median]) * 2 < box->weight) {
+        sum += counts[median];
+        median++;
+    }
+    if (median == box->max[axis]) median--;
+
+    size_t left = box->start;
+    for (size_t i = box->start; i < box->end; i++) {
+        if (channel(colors->rgb[i], axis) <= median) swap_colors(colors, i, left++);
+    }
+
+    *other = (box_t){ .start = left, .end = box->end };
+    box->end = left;
+    box_fit(box, colors);
+    box_fit(other, colors);
+}
+
+static swatch_t box_swatch(const box_t *box, const engine_colors_t *colors) {
+    uint64_t sum[3] = {0};
+    for (size_t i = box->start; i < box->end; i++) {
+        for (int axis = 0; axis < 3; axis++) sum[axis] += channel(colors->rgb[i], axis) * colors->weight[i];
+    }
+    rgb_t rgb = 0;
+    for (int axis = 0; axis < 3; axis++) {
+        rgb = (rgb << 8) | (rgb_t)((sum[axis] + box->weight / 2) / box->weight);
+    }
+    return (swatch_t){ rgb, box->weight };
+}
+
+static bool median_cut_pick(color_stream_t *colors, bool monochrome, accents_t *out) {
+    *out = (accents_t){0};
+
+    engine_colors_t points;
+    if (!engine_collect(colors, MEDIAN_CUT_MAX_COLORS, &points)) return false;
+    if (points.count == 0) return true;
+
+    size_t target = engine_swatches < MEDIAN_CUT_MAX_BOXES ? engine_swatches : MEDIAN_CUT_MAX_BOXES;
+    box_t boxes[MEDIAN_CUT_MAX_BOXES];
+    size_t count = 1;
+    boxes[0] = (box_t){ .start = 0, .end = points.count };
+    box_fit(&boxes[0], &points);
+
+    while (count < target) {
+        size_t widest = 0;
+        double priority = 0;
+        for (size_t i = 0; i < count; i++) {
+            double p = box_priority(&boxes[i]);
+            if (p > priority) {
+                priority = p;
+                widest = i;
+            }
+        }
+        /* Every box is down to one color. */
+        if (priority == 0) break;
+        box_split(&boxes[widest], &boxes[count++], &points);
+    }
+
+    swatch_t swatches[MEDIAN_CUT_MAX_BOXES];
+    for (size_t i = 0; i < count; i++) swatches[i] = box_swatch(&boxes[i], &points);
+    engine_sort_swatches(swatches, count);
+    engine_pick_swatches(swatches, count, monochrome, out);
+
+    engine_colors_free(&points);
+    return true;
+}
+
+const engine_t engine_median_cut = {
+    .name = "median-cut",
+    .pick = median_cut_pick,
+};
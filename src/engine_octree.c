@@ -0,0 +1,291 @@
+#include <stdlib.h>
+
+#include "engine.h"
+#include "config.h"
+
+/* Octree quantizer fed straight from the pixels, in the streaming pass,
+ * without the histogram. Level n of the tree splits on bit 7-n of each
+ * channel, colors end in leaves at level 8. Nodes come from a fixed arena
+ * per worker: when it runs low the deepest inner node is folded into a
+ * leaf holding the sums of its children, so memory stays the same however
+ * many colors the image has. At the end the worker trees are merged and
+ * folded down to `engine_swatches` leaves, each reported at the mean of
+ * its pixels. */
+
+#define OCTREE_DEPTH 8
+#define OCTREE_NODES (1u << 15)
+#define OCTREE_NONE  0  /* no child, the root is never one */
+#define OCTREE_BLOCK 256
+
+typedef struct {
+    uint64_t r, g, b, count;
+    uint32_t child[8];
+    /* Next in the inner node list of its level, or in the free list. */
+    uint32_t next;
+    bool leaf;
+} node_t;
+
+typedef struct {
+    node_t *nodes;
+    uint32_t used;
+    uint32_t free_list;
+    uint32_t free_count;
+    uint32_t inner[OCTREE_DEPTH];
+    size_t leaves;
+    /* Leaf of the last color added, for runs of the same color. */
+    rgb_t last_rgb;
+    uint32_t last_leaf;
+} octree_t;
+
+typedef struct {
+    octree_t *trees;
+    size_t workers;
+} octree_state_t;
+
+static bool octree_init(octree_t *tree) {
+    *tree = (octree_t){0};
+    tree->nodes = malloc(OCTREE_NODES * sizeof(node_t));
+    if (!tree->nodes) return false;
+    tree->nodes[0] = (node_t){0};
+    tree->used = 1;
+    tree->inner[0] = OCTREE_NONE;
+    tree->last_leaf = OCTREE_NONE;
+    return true;
+}
+
+static uint32_t node_alloc(octree_t *tree, int level) {
+    uint32_t index;
+    if (tree->free_count) {
+        index = tree->free_list;
+        tree->free_list = tree->nodes[index].next;
+        tree->free_count--;
+    } else {
+        index = tree->used++;
+    }
+    node_t *node = &tree->nodes[index];
+    *node = (node_t){ .leaf = level == OCTREE_DEPTH };
+    if (node->leaf) {
+        tree->leaves++;
+    } else {
+        node->next = tree->inner[level];
+        tree->inner[level] = index;
+    }
+    return index;
+}
+
+static uint32_t nodes_left(const octree_t *tree) {
+    return OCTREE_NODES - tree->used + tree->free_count;
+}
+
+static uint64_t subtree_count(const octree_t *tree, uint32_t index) {
+    const node_t *node = &tree->nodes[index];
+    uint64_t count = node->count;
+    for (int i = 0; i < 8; i++) {
+        if (node->child[i] != OCTREE_NONE) count += tree->nodes[node->child[i]].count;
+    }
+    return count;
+}
+
+/* Turns an inner node whose children are all leaves into a leaf holding
+ * their sums. */
+static void octree_fold(octree_t *tree, uint32_t index) {
+    node_t *node = &tree->nodes[index];
+    for (int i = 0; i < 8; i++) {
+        uint32_t c = node->child[i];
+        if (c == OCTREE_NONE) continue;
+        node_t *child = &tree->nodes[c];
+        node->r += child->r;
+        node->g += child->g;
+        node->b += child->b;
+        node->count += child->count;
+        child->next = tree->free_list;
+        tree->free_list = c;
+        tree->free_count++;
+        tree->leaves--;
+        node->child[i] = OCTREE_NONE;
+    }
+    node->leaf = true;
+    tree->leaves++;
+    tree->last_leaf = OCTREE_NONE;
+}
+
+/* Folds the newest inner node of the deepest level that has any, whose
+ * children are all leaves then. */
+static bool octree_reduce(octree_t *tree) {
+    int level = OCTREE_DEPTH - 1;
+    while (level >= 0 && tree->inner[level] == OCTREE_NONE) level--;
+    if (level < 0) return false;
+
+    uint32_t index = tree->inner[level];
+    tree->inner[level] = tree->nodes[index].next;
+    octree_fold(tree, index);
+    return true;
+}
+
+typedef struct {
+    uint64_t count;
+    uint32_t index;
+} inner_t;
+
+static int compare_inner(const void *a, const void *b) {
+    const inner_t *x = a, *y = b;
+    if (x->count != y->count) return x->count < y->count ? -1 : 1;
+    return (x->index > y->index) - (x->index < y->index);
+}
+
+/* Folds the least used inner nodes, deepest level first, until at most
+ * `target` leaves are left. Folding a node does not change the others of
+ * its level, so each level is sorted once. */
+static bool octree_reduce_to(octree_t *tree, size_t target) {
+    inner_t *inner = malloc(OCTREE_NODES * sizeof(inner_t));
+    if (!inner) return false;
+
+    for (int level = OCTREE_DEPTH - 1; level >= 0 && tree->leaves > target; level--) {
+        size_t count = 0;
+        for (uint32_t at = tree->inner[level]; at != OCTREE_NONE; at = tree->nodes[at].next) {
+            inner[count++] = (inner_t){ subtree_count(tree, at), at };
+        }
+        qsort(inner, count, sizeof(inner_t), compare_inner);
+
+        size_t folded = 0;
+        while (folded < count && tree->leaves > target) octree_fold(tree, inner[folded++].index);
+
+        tree->inner[level] = OCTREE_NONE;
+        for (size_t i = count; i > folded; i--) {
+            tree->nodes[inner[i - 1].index].next = tree->inner[level];
+            tree->inner[level] = inner[i - 1].index;
+        }
+    }
+
+    free(inner);
+    return true;
+}
+
+/* `count` pixels with channel sums r, g, b, placed by `rgb`. */
+static void octree_add(octree_t *tree, rgb_t rgb, uint64_t r, uint64_t g, uint64_t b, uint64_t count) {
+    uint32_t leaf = tree->last_leaf;
+    if (leaf == OCTREE_NONE || rgb != tree->last_rgb) {
+        /* An insert makes at most one node per level. */
+        while (nodes_left(tree) < OCTREE_DEPTH && octree_reduce(tree)) {}
+
+        leaf = 0;
+        for (int level = 0; level < OCTREE_DEPTH && !tree->nodes[leaf].leaf; level++) {
+            int shift = 7 - level;
+            int i = ((rgb >> (16 + shift)) & 1) << 2 | ((rgb >> (8 + shift)) & 1) << 1 | ((rgb >> shift) & 1);
+            uint32_t child = tree->nodes[leaf].child[i];
+            if (child == OCTREE_NONE) {
+                child = node_alloc(tree, level + 1);
+                tree->nodes[leaf].child[i] = child;
+            }
+            leaf = child;
+        }
+        tree->last_rgb = rgb;
+        tree->last_leaf = leaf;
+    }
+
+    node_t *node = &tree->nodes[leaf];
+    node->r += r;
+    node->g += g;
+    node->b += b;
+    node->count += count;
+}
+
+static rgb_t node_mean(const node_t *node) {
+    uint64_t half = node->count / 2;
+    return (rgb_t)((node->r + half) / node->count) << 16 |
+           (rgb_t)((node->g + half) / node->count) << 8 |
+           (rgb_t)((node->b + half) / node->count);
+}
+
+/* Calls `fn` on every leaf holding pixels below `index`. */
+static void octree_leaves(const octree_t *tree, uint32_t index, void (*fn)(void *, const node_t *), void *user) {
+    const node_t *node = &tree->nodes[index];
+    if (node->leaf) {
+        if (node->count) fn(user, node);
+        return;
+    }
+    for (int i = 0; i < 8; i++) {
+        if (node->child[i] != OCTREE_NONE) octree_leaves(tree, node->child[i], fn, user);
+    }
+}
+
+/* -- Engine -- */
+
+static void *octree_begin(size_t workers) {
+    octree_state_t *state = malloc(sizeof(octree_state_t));
+    if (!state) return NULL;
+    state->workers = workers;
+    state->trees = calloc(workers, sizeof(octree_t));
+    bool ok = state->trees != NULL;
+    for (size_t i = 0; ok && i < workers; i++) ok = octree_init(&state->trees[i]);
+    if (!ok) {
+        for (size_t i = 0; state->trees && i < workers; i++) free(state->trees[i].nodes);
+        free(state->trees);
+        free(state);
+        return NULL;
+    }
+    return state;
+}
+
+static void octree_add_rgba(void *user, size_t worker, const uint8_t *rgba, size_t count) {
+    octree_state_t *state = user;
+    octree_t *tree = &state->trees[worker];
+    rgb_t block[OCTREE_BLOCK];
+    for (size_t start = 0; start < count; start += OCTREE_BLOCK) {
+        size_t n = count - start < OCTREE_BLOCK ? count - start : OCTREE_BLOCK;
+        unpack_rgba(rgba + start * 4, block, n);
+        for (size_t i = 0; i < n; i++) {
+            rgb_t rgb = block[i];
+            octree_add(tree, rgb, (rgb >> 16) & 0xFF, (rgb >> 8) & 0xFF, rgb & 0xFF, 1);
+        }
+    }
+}
+
+static void merge_leaf(void *user, const node_t *node) {
+    octree_add(user, node_mean(node), node->r, node->g, node->b, node->count);
+}
+
+typedef struct {
+    swatch_t *swatches;
+    size_t count;
+} swatch_list_t;
+
+static void collect_leaf(void *user, const node_t *node) {
+    swatch_list_t *list = user;
+    list->swatches[list->count++] = (swatch_t){ node_mean(node), node->count };
+}
+
+static bool octree_finish(void *user, bool monochrome, accents_t *out) {
+    octree_state_t *state = user;
+    octree_t *tree = &state->trees[0];
+    /* A merged leaf goes in at its mean color, its sums stay exact. */
+    for (size_t w = 1; w < state->workers; w++) {
+        octree_leaves(&state->trees[w], 0, merge_leaf, tree);
+    }
+    swatch_list_t list = { NULL, 0 };
+    if (octree_reduce_to(tree, engine_swatches)) list.swatches = malloc((tree->leaves + 1) * sizeof(swatch_t));
+    if (!list.swatches) {
+        fprintf(stderr, "ERROR: Out of memory!\n");
+        return false;
+    }
+    octree_leaves(tree, 0, collect_leaf, &list);
+    engine_sort_swatches(list.swatches, list.count);
+    engine_pick_swatches(list.swatches, list.count, monochrome, out);
+    free(list.swatches);
+    return true;
+}
+
+static void octree_end(void *user) {
+    octree_state_t *state = user;
+    for (size_t i = 0; i < state->workers; i++) free(state->trees[i].nodes);
+    free(state->trees);
+    free(state);
+}
+
+const engine_t engine_octree = {
+    .name     = "octree",
+    .begin    = octree_begin,
+    .add_rgba = octree_add_rgba,
+    .finish   = octree_finish,
+    .end      = octree_end,
+};
@@ -0,0 +1,101 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "exif.h"
+
+#define TAG_COMPRESSION        0x0103
+#define TAG_JPEG_OFFSET        0x0201
+#define TAG_JPEG_LENGTH        0x0202
+#define COMPRESSION_JPEG       6
+#define COMPRESSION_OLD_JPEG   7
+
+typedef struct {
+    const unsigned char *data;
+    size_t len;
+    bool big_endian;
+} tiff_t;
+
+static bool tiff_u16(const tiff_t *t, size_t at, uint32_t *out) {
+    if (at > t->len || t->len - at < 2) return false;
+    const unsigned char *p = t->data + at;
+    *out = t->big_endian ? (p[0] << 8) | p[1] : (p[1] << 8) | p[0];
+    return true;
+}
+
+static bool tiff_u32(const tiff_t *t, size_t at, uint32_t *out) {
+    if (at > t->len || t->len - at < 4) return false;
+    const unsigned char *p = t->data + at;
+    *out = t->big_endian
+        ? ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3]
+        : ((uint32_t)p[3] << 24) | ((uint32_t)p[2] << 16) | ((uint32_t)p[1] << 8) | p[0];
+    return true;
+}
+
+/* Entries are 12 bytes: tag, type, count, then the value itself when it
+ * fits in 4 bytes, which is the case for every tag read here. */
+static bool tiff_entry_value(const tiff_t *t, size_t entry, uint32_t *out) {
+    uint32_t type;
+    if (!tiff_u16(t, entry + 2, &type)) return false;
+    if (type == 3) return tiff_u16(t, entry + 8, out); /* SHORT */
+    if (type == 4) return tiff_u32(t, entry + 8, out); /* LONG */
+    return false;
+}
+
+static bool tiff_thumbnail(const tiff_t *t, const unsigned char **thumb, size_t *thumb_len) {
+    uint32_t magic, ifd0, count, ifd1;
+    if (!tiff_u16(t, 2, &magic) || magic != 42) return false;
+    if (!tiff_u32(t, 4, &ifd0) || !tiff_u16(t, ifd0, &count)) return false;
+
+    /* The thumbnail lives in IFD1, linked right after IFD0's entries. */
+    if (!tiff_u32(t, (size_t)ifd0 + 2 + (size_t)count * 12, &ifd1) || ifd1 == 0) return false;
+    if (!tiff_u16(t, ifd1, &count)) return false;
+
+    uint32_t compression = COMPRESSION_JPEG, offset = 0, length = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        size_t entry = (size_t)ifd1 + 2 + (size_t)i * 12;
+        uint32_t tag, value;
+        if (!tiff_u16(t, entry, &tag)) return false;
+        if (!tiff_entry_value(t, entry, &value)) continue;
+        switch (tag) {
+        case TAG_COMPRESSION: compression = value; break;
+        case TAG_JPEG_OFFSET: offset = value; break;
+        case TAG_JPEG_LENGTH: length = value; break;
+        default: break;
+        }
+    }
+
+    if (compression != COMPRESSION_JPEG && compression != COMPRESSION_OLD_JPEG) return false;
+    if (offset == 0 || length < 4 || offset > t->len || t->len - offset < length) return false;
+    if (t->data[offset] != 0xFF || t->data[offset + 1] != 0xD8) return false;
+
+    *thumb = t->data + offset;
+    *thumb_len = length;
+    return true;
+}
+
+bool exif_thumbnail(const unsigned char *buffer, size_t len, const unsigned char **thumb, size_t *thumb_len) {
+    if (len < 4 || buffer[0] != 0xFF || buffer[1] != 0xD8) return false;
+
+    size_t at = 2;
+    while (at + 4 <= len) {
+        if (buffer[at] != 0xFF) return false;
+        unsigned char marker = buffer[at + 1];
+        if (marker == 0xFF) { at++; continue; } /* fill byte */
+        if (marker == 0xDA || marker == 0xD9) return false; /* SOS, EOI */
+
+        size_t size = (buffer[at + 2] << 8) | buffer[at + 3];
+        if (size < 2 || size > len - at - 2) return false;
+
+        const unsigned char *payload = buffer + at + 4;
+        size_t payload_len = size - 2;
+        if (marker == 0xE1 && payload_len > 14 && memcmp(payload, "Exif\0\0", 6) == 0) {
+            tiff_t t = { payload + 6, payload_len - 6, payload[6] == 'M' };
+            if ((payload[6] == 'I' || payload[6] == 'M') && payload[7] == payload[6] &&
+                    tiff_thumbnail(&t, thumb, thumb_len)) {
+                return true;
+            }
+        }
+        at += 2 + size;
+    }
+    return false;
+}
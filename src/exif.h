@@ -0,0 +1,12 @@
+#ifndef EXIF_H
+#define EXIF_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Find the JPEG thumbnail embedded in the EXIF APP1 segment of a JPEG,
+ * only walking the segments before the first scan. On success `thumb`
+ * points inside `buffer`. */
+bool exif_thumbnail(const unsigned char *buffer, size_t len, const unsigned char **thumb, size_t *thumb_len);
+
+#endif /* EXIF_H */
@@ -0,0 +1,27 @@
+#include "filter.h"
+
+void hsv_filter_init(hsv_filter_t *filter, float min_v, float max_v, float min_s, float max_s) {
+    /* Empty until proven otherwise. */
+    filter->min_max = 255;
+    filter->max_max = 0;
+
+    for (int max = 0; max < 256; max++) {
+        float v = max / 255.0f;
+        if (v >= min_v && v <= max_v) {
+            if (max < filter->min_max) filter->min_max = max;
+            filter->max_max = max;
+        }
+
+        filter->min_delta[max] = 255;
+        filter->max_delta[max] = 0;
+        for (int delta = 0; delta <= max; delta++) {
+            /* Same float operations as rgb_to_hsv(). */
+            float fmax = max / 255.0f;
+            float fmin = (max - delta) / 255.0f;
+            float s = (fmax == 0.0f) ? 0.0f : ((fmax - fmin) / fmax);
+            if (s < min_s || s > max_s) continue;
+            if (delta < filter->min_delta[max]) filter->min_delta[max] = delta;
+            filter->max_delta[max] = delta;
+        }
+    }
+}
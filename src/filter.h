@@ -0,0 +1,31 @@
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "helper.h"
+
+/* Value / saturation range test done on integers: V is max(r,g,b)/255 and
+ * S*V is (max-min)/255, so each float threshold turns into a bound on
+ * max, and for every max a bound on max-min. The bounds are found by
+ * running the exact float expressions of rgb_to_hsv() once, so a color
+ * passes here exactly when its float V and S are within range. */
+typedef struct {
+    uint8_t min_max, max_max;
+    uint8_t min_delta[256];
+    uint8_t max_delta[256];
+} hsv_filter_t;
+
+void hsv_filter_init(hsv_filter_t *filter, float min_v, float max_v, float min_s, float max_s);
+
+static inline bool hsv_filter_accepts(const hsv_filter_t *filter, rgb_t rgb) {
+    uint8_t r = rgb >> 16, g = rgb >> 8, b = rgb;
+    uint8_t max = r > g ? (r > b ? r : b) : (g > b ? g : b);
+    uint8_t min = r < g ? (r < b ? r : b) : (g < b ? g : b);
+    uint8_t delta = max - min;
+    return max >= filter->min_max && max <= filter->max_max &&
+           delta >= filter->min_delta[max] && delta <= filter->max_delta[max];
+}
+
+#endif /* FILTER_H */
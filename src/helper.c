@@ -1,73 +1,77 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
 #include "helper.h"
+#include "config.h"
+
+/* The conversions and the slot mapping live in color.h, shared with the
+ * C++ engine; the C engine works with hue in turns. */
 
 hsv_t rgb_to_hsv(rgb_t rgb) {
-    float r = ((rgb >> 16) & 0xFF) / 255.0f;
-    float g = ((rgb >> 8)  & 0xFF) / 255.0f;
-    float b = ( rgb        & 0xFF) / 255.0f;
-
-    float max = (r > g) ? ((r > b) ? r : b) : ((g > b) ? g : b);
-    float min = (r < g) ? ((r < b) ? r : b) : ((g < b) ? g : b);
-    float delta = max - min;
-
-    hsv_t out;
-    out.v = max;
-
-    // Saturation
-    out.s = (max == 0.0f) ? 0.0f : (delta / max);
-
-    // Hue
-    if (delta == 0.0f) {
-        out.h = 0.0f; // undefined hue
-    } else if (max == r) {
-        out.h = ( (g - b) / delta );
-    } else if (max == g) {
-        out.h = ( (b - r) / delta ) + 2.0f;
-    } else {
-        out.h = ( (r - g) / delta ) + 4.0f;
-    }
+    return color_rgb_to_hsv_f(rgb, HUE_TURNS);
+}
 
-    out.h /= 6.0f;
-    if (out.h < 0.0f) out.h += 1.0f;
+rgb_t hsv_to_rgb(hsv_t hsv) {
+    return color_hsv_to_rgb_f(hsv, HUE_TURNS);
+}
 
-    return out;
+void rgb_to_hsv_n(const rgb_t *rgb, float *h, float *s, float *v, size_t count) {
+    color_rgb_to_hsv_n(rgb, h, s, v, count, HUE_TURNS);
 }
 
-rgb_t hsv_to_rgb(hsv_t hsv) {
-    float h = hsv.h;
-    float s = hsv.s;
-    float v = hsv.v;
-
-    float r, g, b;
-    r = 0;
-    g = 0;
-    b = 0;
-
-    if (s == 0.0f) {
-        // Achromatic (grey)
-        r = g = b = v;
-    } else {
-        h = h * 6.0f;  // sector 0 to 5
-        int i = (int)h;
-        float f = h - i;
-        float p = v * (1.0f - s);
-        float q = v * (1.0f - s * f);
-        float t = v * (1.0f - s * (1.0f - f));
-
-        switch (i % 6) {
-            case 0: r = v; g = t; b = p; break;
-            case 1: r = q; g = v; b = p; break;
-            case 2: r = p; g = v; b = t; break;
-            case 3: r = p; g = q; b = v; break;
-            case 4: r = t; g = p; b = v; break;
-            case 5: r = v; g = p; b = q; break;
-        }
+void hsv_to_rgb_n(const float *h, const float *s, const float *v, rgb_t *rgb, size_t count) {
+    color_hsv_to_rgb_n(h, s, v, rgb, count, HUE_TURNS);
+}
+
+oklab_t rgb_to_oklab(rgb_t rgb) {
+    return color_rgb_to_oklab(rgb);
+}
+
+void rgb_to_oklab_n(const rgb_t *rgb, float *L, float *a, float *b, size_t count) {
+    color_rgb_to_oklab_n(rgb, L, a, b, count);
+}
+
+#define BENCH_ROUNDS 3
+#define BENCH_COLORS (1u << 24)
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+void color_benchmark(FILE *out) {
+    rgb_t *rgb = malloc(BENCH_COLORS * sizeof(rgb_t));
+    float *x = malloc(BENCH_COLORS * sizeof(float));
+    float *y = malloc(BENCH_COLORS * sizeof(float));
+    float *z = malloc(BENCH_COLORS * sizeof(float));
+    if (!rgb || !x || !y || !z) {
+        fprintf(stderr, "ERROR: Out of memory!\n");
+        free(rgb); free(x); free(y); free(z);
+        return;
+    }
+    for (rgb_t i = 0; i < BENCH_COLORS; i++) rgb[i] = i;
+
+    double hsv = -1, oklab = -1;
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        double start = now_ms();
+        rgb_to_hsv_n(rgb, x, y, z, BENCH_COLORS);
+        double took = now_ms() - start;
+        if (hsv < 0 || took < hsv) hsv = took;
+
+        start = now_ms();
+        rgb_to_oklab_n(rgb, x, y, z, BENCH_COLORS);
+        took = now_ms() - start;
+        if (oklab < 0 || took < oklab) oklab = took;
     }
 
-    uint8_t R = (uint8_t)(r * 255.0f + 0.5f);
-    uint8_t G = (uint8_t)(g * 255.0f + 0.5f);
-    uint8_t B = (uint8_t)(b * 255.0f + 0.5f);
+    fprintf(out, "%u colors, best of %d\n", BENCH_COLORS, BENCH_ROUNDS);
+    fprintf(out, "%-8s %10s %10s\n", "space", "ms", "Mcolor/s");
+    fprintf(out, "%-8s %10.2f %10.1f\n", "hsv", hsv, BENCH_COLORS / hsv / 1e3);
+    fprintf(out, "%-8s %10.2f %10.1f\n", "oklab", oklab, BENCH_COLORS / oklab / 1e3);
 
-    return (R << 16) | (G << 8) | B;
+    free(rgb); free(x); free(y); free(z);
 }
 
 float clamp(float value, float min, float max) {
@@ -76,34 +80,28 @@ float clamp(float value, float min, float max) {
     return value;
 }
 
-color_e tell_color(hsv_t hsv) {
-    if (hsv.s < 0.1f || hsv.v < 0.1f) {
-        return SHADE;
+static hue_bins_t color_bins;
+static pthread_once_t color_bins_once = PTHREAD_ONCE_INIT;
+
+static void color_bins_init(void) {
+    if (!hue_bins_init(&color_bins, hue_bins, sizeof(hue_bins) / sizeof(hue_bins[0]), HUE_TURNS)) {
+        fprintf(stderr, "ERROR: hue_bins in config.h must be sorted, in [0, 1) and not closer than 1/%d!\n",
+                HUE_BIN_STEPS);
+        exit(1);
     }
+}
+
+color_e tell_color(hsv_t hsv) {
+    pthread_once(&color_bins_once, color_bins_init);
+    color_e color = (color_e)hue_bins_classify(&color_bins, hsv.h);
+    return (hsv.s < 0.1f || hsv.v < 0.1f) ? SHADE : color;
+}
 
-    float h = hsv.h;
-
-    // The boundary values have been divided by 360.
-    // 15/360   = 0.0416f
-    // 75/360   = 0.2083f
-    // 150/360  = 0.4167f
-    // 210/360  = 0.5833f
-    // 270/360  = 0.75f
-    // 330/360  = 0.9167f
-    if (h >= 0.0416f && h < 0.2083f) {
-        return ORANGE;
-    } else if (h >= 0.2083f && h < 0.4167f) {
-        return GREEN;
-    } else if (h >= 0.4167f && h < 0.5833f) {
-        return CYAN;
-    } else if (h >= 0.5833f && h < 0.75f) {
-        return BLUE;
-    } else if (h >= 0.75f && h < 0.9167f) {
-        return MAGENTA;
-    } else {
-        // This 'else' correctly covers the Red range which wraps around 0.0/1.0
-        // (i.e., from 0.9167 to 1.0 AND from 0.0 to 0.0833)
-        return RED;
+void tell_color_n(const float *h, const float *s, const float *v, uint8_t *out, size_t count) {
+    pthread_once(&color_bins_once, color_bins_init);
+    hue_bins_classify_n(&color_bins, h, out, count);
+    for (size_t i = 0; i < count; i++) {
+        out[i] = (s[i] < 0.1f || v[i] < 0.1f) ? SHADE : out[i];
     }
 }
 
@@ -129,84 +127,15 @@ const char *color_enum_to_str(color_e color) {
 }
 
 void color_enum_to_mapping(color_e color, uint8_t *a, uint8_t *b) {
-    switch (color) {
-        case RED:
-            *a = 12;
-            *b = 4;
-            return;
-        case GREEN:
-            *a = 10;
-            *b = 2;
-            return;
-        case BLUE:
-            *a = 9;
-            *b = 1;
-            return;
-        case CYAN:
-            *a = 11;
-            *b = 3;
-            return;
-        case MAGENTA:
-            *a = 13;
-            *b = 5;
-            return;
-        case ORANGE:
-            *a = 14;
-            *b = 6;
-            return;
-        default:
-            return;
-    }
+    if (color == SHADE) return;
+    *a = color_slot_bright(color);
+    *b = color_slot_dark(color);
 }
 
 color_e mapping_to_color_enum(uint8_t a) {
-    switch (a) {
-        case 12:
-        case 4:
-            return RED;
-
-        case 10:
-        case 2:
-            return GREEN;
-
-        case 9:
-        case 1:
-            return BLUE;
-
-        case 11:
-        case 3:
-            return CYAN;
-
-        case 13:
-        case 5:
-            return MAGENTA;
-
-        case 14:
-        case 6:
-            return ORANGE;
-
-        default:
-            return SHADE;
-    }
+    return color_from_slot(a);
 }
 
 float get_base_hue(color_e color) {
-    switch (color) {
-        case RED:
-            return 0.0f;
-        case ORANGE:
-            return 0.125f;
-        case GREEN:
-            return 0.3125f;
-        case CYAN:
-            return 0.5f;
-        case BLUE:
-            return 0.6667f;
-        case MAGENTA:
-            return 0.8333f;
-        case SHADE:
-            return 0.0f;
-        default:
-            return 0.0f;
-    }
+    return color_base_hue_f(color, HUE_TURNS);
 }
@@ -1,29 +1,17 @@
 #ifndef HELPER_H
 #define HELPER_H
 
+#include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 
-typedef uint32_t rgb_t;
-
-typedef struct  {
-    float h, s, v;
-} hsv_t;
+#include "color.h"
 
 typedef struct {
     uint32_t first;
     uint32_t second;
 } pair_t;
 
-typedef enum {
-    RED,
-    GREEN,
-    BLUE,
-    CYAN,
-    MAGENTA,
-    ORANGE,
-    SHADE
-} color_e;
-
 /*
 inline uint32_t pack_color_555(uint8_t r, uint8_t g, uint8_t b) {
     return ((r >> 3) << 10) | ((g >> 3) << 5) | (b >> 3);
@@ -39,8 +27,21 @@ inline rgb_t unpack_color_555(uint32_t idx) {
 hsv_t rgb_to_hsv(rgb_t rgb);
 rgb_t hsv_to_rgb(hsv_t hsv);
 
+/* Batch versions over structure-of-arrays HSV, vectorized with the SIMD
+ * level picked by cpu.h and bit-identical to the scalar ones. */
+void rgb_to_hsv_n(const rgb_t *rgb, float *h, float *s, float *v, size_t count);
+void hsv_to_rgb_n(const float *h, const float *s, const float *v, rgb_t *rgb, size_t count);
+
+oklab_t rgb_to_oklab(rgb_t rgb);
+void rgb_to_oklab_n(const rgb_t *rgb, float *L, float *a, float *b, size_t count);
+
+/* Time the batch HSV and OKLab conversions over the whole RGB cube. */
+void color_benchmark(FILE *out);
+
 float clamp(float value, float min, float max);
 color_e tell_color(hsv_t hsv);
+/* Batch tell_color over structure-of-arrays HSV, one color_e per byte. */
+void tell_color_n(const float *h, const float *s, const float *v, uint8_t *out, size_t count);
 const char *color_enum_to_str(color_e color);
 void color_enum_to_mapping(color_e color, uint8_t *a, uint8_t *b);
 color_e mapping_to_color_enum(uint8_t a);
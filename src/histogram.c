@@ -0,0 +1,533 @@
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "histogram.h"
+
+#if defined(__x86_64__)
+#define HISTOGRAM_X86
+#include <immintrin.h>
+#endif
+
+#define TABLE_EMPTY 0xFFFFFFFFu
+#define TABLE_HASH  0x9E3779B1u
+#define RUN_BUFFER  1024
+#define BLOCK       256
+
+struct run_cursor {
+    const pair_t *mem;  /* in-memory run, or */
+    int fd;             /* a run inside a spill file */
+    off_t offset;
+    uint64_t remaining;
+
+    pair_t buf[RUN_BUFFER];
+    size_t pos, len;
+
+    /* Where the run starts, for color_stream_rewind(). */
+    const pair_t *mem_start;
+    off_t start;
+    uint64_t length;
+};
+
+/* A sorted run inside a spill file. */
+typedef struct {
+    int fd;
+    off_t offset;
+    uint64_t length;
+} run_ref_t;
+
+/* -- Kernels -- */
+
+/* Pixels are unpacked and hashed a block at a time with the widest
+ * variant cpu.h allows, the counting itself is a scatter and stays
+ * scalar. A little-endian RGBA word is A<<24 | B<<16 | G<<8 | R. */
+
+static void unpack_rgba_scalar(const uint8_t *rgba, rgb_t *out, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        const uint8_t *p = rgba + i * 4;
+        out[i] = (p[0] << 16) | (p[1] << 8) | p[2];
+    }
+}
+
+static void hash_rgb_scalar(const rgb_t *rgb, uint32_t *hash, size_t count) {
+    for (size_t i = 0; i < count; i++) hash[i] = (rgb[i] * TABLE_HASH) >> 8;
+}
+
+#ifdef HISTOGRAM_X86
+__attribute__((target("sse2")))
+static void unpack_rgba_sse2(const uint8_t *rgba, rgb_t *out, size_t count) {
+    const __m128i lo = _mm_set1_epi32(0xFF);
+    const __m128i mid = _mm_set1_epi32(0xFF00);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i px = _mm_loadu_si128((const __m128i *)(rgba + i * 4));
+        __m128i r = _mm_slli_epi32(_mm_and_si128(px, lo), 16);
+        __m128i b = _mm_and_si128(_mm_srli_epi32(px, 16), lo);
+        _mm_storeu_si128((__m128i *)(out + i), _mm_or_si128(_mm_or_si128(r, _mm_and_si128(px, mid)), b));
+    }
+    unpack_rgba_scalar(rgba + i * 4, out + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void unpack_rgba_avx2(const uint8_t *rgba, rgb_t *out, size_t count) {
+    const __m256i lo = _mm256_set1_epi32(0xFF);
+    const __m256i mid = _mm256_set1_epi32(0xFF00);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i px = _mm256_loadu_si256((const __m256i *)(rgba + i * 4));
+        __m256i r = _mm256_slli_epi32(_mm256_and_si256(px, lo), 16);
+        __m256i b = _mm256_and_si256(_mm256_srli_epi32(px, 16), lo);
+        _mm256_storeu_si256((__m256i *)(out + i), _mm256_or_si256(_mm256_or_si256(r, _mm256_and_si256(px, mid)), b));
+    }
+    unpack_rgba_sse2(rgba + i * 4, out + i, count - i);
+}
+
+__attribute__((target("avx512f")))
+static void unpack_rgba_avx512(const uint8_t *rgba, rgb_t *out, size_t count) {
+    const __m512i lo = _mm512_set1_epi32(0xFF);
+    const __m512i mid = _mm512_set1_epi32(0xFF00);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m512i px = _mm512_loadu_si512((const void *)(rgba + i * 4));
+        __m512i r = _mm512_slli_epi32(_mm512_and_si512(px, lo), 16);
+        __m512i b = _mm512_and_si512(_mm512_srli_epi32(px, 16), lo);
+        _mm512_storeu_si512((void *)(out + i), _mm512_or_si512(_mm512_or_si512(r, _mm512_and_si512(px, mid)), b));
+    }
+    unpack_rgba_avx2(rgba + i * 4, out + i, count - i);
+}
+
+__attribute__((target("sse4.1")))
+static void hash_rgb_sse41(const rgb_t *rgb, uint32_t *hash, size_t count) {
+    const __m128i k = _mm_set1_epi32((int)TABLE_HASH);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i px = _mm_loadu_si128((const __m128i *)(rgb + i));
+        _mm_storeu_si128((__m128i *)(hash + i), _mm_srli_epi32(_mm_mullo_epi32(px, k), 8));
+    }
+    hash_rgb_scalar(rgb + i, hash + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void hash_rgb_avx2(const rgb_t *rgb, uint32_t *hash, size_t count) {
+    const __m256i k = _mm256_set1_epi32((int)TABLE_HASH);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i px = _mm256_loadu_si256((const __m256i *)(rgb + i));
+        _mm256_storeu_si256((__m256i *)(hash + i), _mm256_srli_epi32(_mm256_mullo_epi32(px, k), 8));
+    }
+    hash_rgb_sse41(rgb + i, hash + i, count - i);
+}
+
+__attribute__((target("avx512f")))
+static void hash_rgb_avx512(const rgb_t *rgb, uint32_t *hash, size_t count) {
+    const __m512i k = _mm512_set1_epi32((int)TABLE_HASH);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m512i px = _mm512_loadu_si512((const void *)(rgb + i));
+        _mm512_storeu_si512((void *)(hash + i), _mm512_srli_epi32(_mm512_mullo_epi32(px, k), 8));
+    }
+    hash_rgb_avx2(rgb + i, hash + i, count - i);
+}
+#endif /* HISTOGRAM_X86 */
+
+void unpack_rgba(const uint8_t *rgba, rgb_t *out, size_t count) {
+    switch (cpu_pick(HISTOGRAM_UNPACK_LEVELS)) {
+#ifdef HISTOGRAM_X86
+    case CPU_AVX512: unpack_rgba_avx512(rgba, out, count); return;
+    case CPU_AVX2:   unpack_rgba_avx2(rgba, out, count); return;
+    case CPU_SSE2:   unpack_rgba_sse2(rgba, out, count); return;
+#endif
+    default:         unpack_rgba_scalar(rgba, out, count); return;
+    }
+}
+
+void hash_rgb(const rgb_t *rgb, uint32_t *hash, size_t count) {
+    switch (cpu_pick(HISTOGRAM_HASH_LEVELS)) {
+#ifdef HISTOGRAM_X86
+    case CPU_AVX512: hash_rgb_avx512(rgb, hash, count); return;
+    case CPU_AVX2:   hash_rgb_avx2(rgb, hash, count); return;
+    case CPU_SSE41:  hash_rgb_sse41(rgb, hash, count); return;
+#endif
+    default:         hash_rgb_scalar(rgb, hash, count); return;
+    }
+}
+
+static inline uint32_t add_saturated(uint32_t a, uint32_t b) {
+    return (a > UINT32_MAX - b) ? UINT32_MAX : a + b;
+}
+
+bool histogram_init(histogram_t *hist) {
+    hist->freq = calloc(HISTOGRAM_SIZE, sizeof(uint32_t));
+    hist->color_count = 0;
+    hist->pixel_count = 0;
+    return hist->freq != NULL;
+}
+
+void histogram_add_rgba(histogram_t *hist, const uint8_t *pixels, size_t count) {
+    rgb_t block[BLOCK];
+    for (size_t start = 0; start < count; start += BLOCK) {
+        size_t n = count - start < BLOCK ? count - start : BLOCK;
+        unpack_rgba(pixels + start * 4, block, n);
+        for (size_t i = 0; i < n; i++) {
+            uint32_t *f = &hist->freq[block[i]];
+            if (*f == 0) ++hist->color_count;
+            if (*f != UINT32_MAX) ++*f;
+        }
+    }
+    hist->pixel_count += count;
+}
+
+void histogram_merge_table(histogram_t *hist, const color_table_t *table) {
+    for (size_t i = 0; i < table->capacity; i++) {
+        rgb_t pixel = table->slots[i].first;
+        if (pixel == TABLE_EMPTY) continue;
+        if (hist->freq[pixel] == 0) ++hist->color_count;
+        hist->freq[pixel] = add_saturated(hist->freq[pixel], table->slots[i].second);
+    }
+    hist->pixel_count += table->pixel_count;
+}
+
+static inline void add_shared(uint32_t *freq, uint32_t count) {
+    _Atomic uint32_t *f = (_Atomic uint32_t *)freq;
+    uint32_t old = atomic_load_explicit(f, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak_explicit(f, &old, add_saturated(old, count),
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+void histogram_add_rgba_shared(histogram_t *hist, const uint8_t *pixels, size_t count) {
+    rgb_t block[BLOCK];
+    for (size_t start = 0; start < count; start += BLOCK) {
+        size_t n = count - start < BLOCK ? count - start : BLOCK;
+        unpack_rgba(pixels + start * 4, block, n);
+        for (size_t i = 0; i < n; i++) add_shared(&hist->freq[block[i]], 1);
+    }
+}
+
+void histogram_merge_table_shared(histogram_t *hist, const color_table_t *table) {
+    for (size_t i = 0; i < table->capacity; i++) {
+        rgb_t pixel = table->slots[i].first;
+        if (pixel != TABLE_EMPTY) add_shared(&hist->freq[pixel], table->slots[i].second);
+    }
+}
+
+void histogram_free(histogram_t *hist) {
+    free(hist->freq);
+    hist->freq = NULL;
+}
+
+static inline size_t table_slot(rgb_t pixel, size_t mask) {
+    return ((pixel * TABLE_HASH) >> 8) & mask;
+}
+
+static void clear_slots(pair_t *slots, size_t count) {
+    for (size_t i = 0; i < count; i++) slots[i] = (pair_t){ TABLE_EMPTY, 0 };
+}
+
+bool color_table_init(color_table_t *table, size_t capacity, size_t max_size) {
+    size_t cap = 1024;
+    while (cap < capacity) cap <<= 1;
+
+    memset(table, 0, sizeof(*table));
+    table->slots = malloc(cap * sizeof(pair_t));
+    if (!table->slots) return false;
+    clear_slots(table->slots, cap);
+    table->capacity = cap;
+    table->max_size = max_size;
+    return true;
+}
+
+static bool color_table_grow(color_table_t *table) {
+    size_t cap = table->capacity * 2;
+    pair_t *slots = malloc(cap * sizeof(pair_t));
+    if (!slots) return false;
+    clear_slots(slots, cap);
+
+    size_t mask = cap - 1;
+    for (size_t i = 0; i < table->capacity; i++) {
+        pair_t entry = table->slots[i];
+        if (entry.first == TABLE_EMPTY) continue;
+        size_t slot = table_slot(entry.first, mask);
+        while (slots[slot].first != TABLE_EMPTY) slot = (slot + 1) & mask;
+        slots[slot] = entry;
+    }
+
+    free(table->slots);
+    table->slots = slots;
+    table->capacity = cap;
+    return true;
+}
+
+static int compare_pair(const void *a, const void *b) {
+    rgb_t x = ((const pair_t *)a)->first;
+    rgb_t y = ((const pair_t *)b)->first;
+    return (x > y) - (x < y);
+}
+
+/* Pack the occupied slots to the front in rgb order; the table is no
+ * longer a valid hash table until cleared. */
+static size_t color_table_sort(color_table_t *table) {
+    size_t n = 0;
+    for (size_t i = 0; i < table->capacity; i++) {
+        if (table->slots[i].first != TABLE_EMPTY) table->slots[n++] = table->slots[i];
+    }
+    qsort(table->slots, n, sizeof(pair_t), compare_pair);
+    return n;
+}
+
+static bool color_table_spill(color_table_t *table) {
+    if (!table->spill && !(table->spill = tmpfile())) return false;
+
+    uint64_t *lengths = realloc(table->run_lengths, (table->run_count + 1) * sizeof(uint64_t));
+    if (!lengths) return false;
+    table->run_lengths = lengths;
+
+    size_t n = color_table_sort(table);
+    if (fwrite(table->slots, sizeof(pair_t), n, table->spill) != n) return false;
+    table->run_lengths[table->run_count++] = n;
+
+    clear_slots(table->slots, table->capacity);
+    table->size = 0;
+    return true;
+}
+
+bool color_table_add_rgba(color_table_t *table, const uint8_t *pixels, size_t count) {
+    rgb_t block[BLOCK];
+    uint32_t hash[BLOCK];
+    for (size_t start = 0; start < count; start += BLOCK) {
+        size_t n = count - start < BLOCK ? count - start : BLOCK;
+        unpack_rgba(pixels + start * 4, block, n);
+        hash_rgb(block, hash, n);
+
+        for (size_t i = 0; i < n; i++) {
+            /* Keep the load factor under 1/2 so probe chains stay short. */
+            if (table->size * 2 >= table->capacity) {
+                bool ok = (table->max_size && table->size >= table->max_size)
+                              ? color_table_spill(table)
+                              : color_table_grow(table);
+                if (!ok) return false;
+            }
+
+            rgb_t pixel = block[i];
+            size_t mask = table->capacity - 1;
+            size_t slot = hash[i] & mask;
+            while (table->slots[slot].first != pixel) {
+                if (table->slots[slot].first == TABLE_EMPTY) {
+                    table->slots[slot].first = pixel;
+                    table->size++;
+                    break;
+                }
+                slot = (slot + 1) & mask;
+            }
+            if (table->slots[slot].second != UINT32_MAX) table->slots[slot].second++;
+        }
+    }
+    table->pixel_count += count;
+    return true;
+}
+
+void color_table_free(color_table_t *table) {
+    free(table->slots);
+    free(table->run_lengths);
+    if (table->spill) fclose(table->spill);
+    memset(table, 0, sizeof(*table));
+}
+
+void color_stream_dense(color_stream_t *stream, const histogram_t *hist) {
+    memset(stream, 0, sizeof(*stream));
+    stream->freq = hist->freq;
+}
+
+/* False at the end of the run, or on a read error with `*failed` set. */
+static bool run_fill(run_cursor_t *run, bool *failed) {
+    if (run->pos < run->len) return true;
+    if (run->remaining == 0) return false;
+
+    size_t want = (run->remaining < RUN_BUFFER) ? run->remaining : RUN_BUFFER;
+    if (run->mem) {
+        memcpy(run->buf, run->mem, want * sizeof(pair_t));
+        run->mem += want;
+    } else {
+        ssize_t got = pread(run->fd, run->buf, want * sizeof(pair_t), run->offset);
+        if (got != (ssize_t)(want * sizeof(pair_t))) {
+            *failed = true;
+            return false;
+        }
+        run->offset += got;
+    }
+    run->remaining -= want;
+    run->pos = 0;
+    run->len = want;
+    return true;
+}
+
+static inline rgb_t run_head(const run_cursor_t *run) {
+    return run->buf[run->pos].first;
+}
+
+static void heap_down(color_stream_t *stream, size_t i) {
+    run_cursor_t **heap = stream->heap;
+    for (;;) {
+        size_t l = i * 2 + 1, r = l + 1, m = i;
+        if (l < stream->heap_size && run_head(heap[l]) < run_head(heap[m])) m = l;
+        if (r < stream->heap_size && run_head(heap[r]) < run_head(heap[m])) m = r;
+        if (m == i) return;
+        run_cursor_t *tmp = heap[i];
+        heap[i] = heap[m];
+        heap[m] = tmp;
+        i = m;
+    }
+}
+
+/* A stream over the spilled runs `refs` and, sorted here, `tables`. */
+static bool stream_open(color_stream_t *stream, const run_ref_t *refs, size_t ref_count,
+                        color_table_t *tables, size_t table_count) {
+    size_t runs = ref_count + table_count;
+    stream->runs = calloc(runs, sizeof(run_cursor_t));
+    stream->heap = malloc(runs * sizeof(run_cursor_t *));
+    if (!stream->runs || !stream->heap) return false;
+
+    for (size_t i = 0; i < ref_count; i++) {
+        run_cursor_t *run = &stream->runs[stream->run_count++];
+        run->fd = refs[i].fd;
+        run->start = refs[i].offset;
+        run->length = refs[i].length;
+    }
+    for (size_t i = 0; i < table_count; i++) {
+        run_cursor_t *run = &stream->runs[stream->run_count++];
+        run->length = color_table_sort(&tables[i]);
+        run->mem_start = tables[i].slots;
+    }
+    return color_stream_rewind(stream);
+}
+
+/* Merges `refs` `fan_in` at a time into runs of a new temporary file,
+ * which replaces `*file` (the previous pass, no longer read). */
+static bool merge_pass(run_ref_t *refs, size_t *ref_count, size_t fan_in, FILE **file) {
+    FILE *out = tmpfile();
+    if (!out) return false;
+
+    bool ok = true;
+    size_t merged = 0;
+    off_t offset = 0;
+    for (size_t start = 0; ok && start < *ref_count; start += fan_in) {
+        size_t n = *ref_count - start < fan_in ? *ref_count - start : fan_in;
+        color_stream_t group = {0};
+        ok = stream_open(&group, refs + start, n, NULL, 0);
+        uint64_t length = 0;
+        pair_t entry;
+        while (ok && color_stream_next(&group, &entry)) {
+            ok = fwrite(&entry, sizeof(pair_t), 1, out) == 1;
+            length++;
+        }
+        ok = ok && !group.failed;
+        color_stream_free(&group);
+        /* Written behind the groups still to read. */
+        refs[merged++] = (run_ref_t){ fileno(out), offset, length };
+        offset += length * sizeof(pair_t);
+    }
+
+    if (!ok || fflush(out) != 0) {
+        fclose(out);
+        return false;
+    }
+    if (*file) fclose(*file);
+    *file = out;
+    *ref_count = merged;
+    return true;
+}
+
+bool color_stream_merge(color_stream_t *stream, color_table_t *tables, size_t count, size_t max_bytes) {
+    memset(stream, 0, sizeof(*stream));
+
+    size_t ref_count = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (tables[i].spill && fflush(tables[i].spill) != 0) return false;
+        ref_count += tables[i].run_count;
+    }
+    run_ref_t *refs = malloc((ref_count ? ref_count : 1) * sizeof(run_ref_t));
+    if (!refs) return false;
+    ref_count = 0;
+    for (size_t i = 0; i < count; i++) {
+        off_t offset = 0;
+        for (size_t r = 0; r < tables[i].run_count; r++) {
+            refs[ref_count++] = (run_ref_t){ fileno(tables[i].spill), offset, tables[i].run_lengths[r] };
+            offset += tables[i].run_lengths[r] * sizeof(pair_t);
+        }
+    }
+
+    bool ok = true;
+    if (max_bytes) {
+        /* The tables stay one run each, at least two spilled runs a pass. */
+        size_t fan_in = max_bytes / sizeof(run_cursor_t);
+        fan_in = fan_in > count + 2 ? fan_in - count : 2;
+        while (ok && ref_count > fan_in) ok = merge_pass(refs, &ref_count, fan_in, &stream->spill);
+    }
+    ok = ok && stream_open(stream, refs, ref_count, tables, count);
+    free(refs);
+    if (!ok) color_stream_free(stream);
+    return ok;
+}
+
+bool color_stream_next(color_stream_t *stream, pair_t *out) {
+    if (stream->freq) {
+        while (stream->next < HISTOGRAM_SIZE) {
+            rgb_t pixel = stream->next++;
+            if (stream->freq[pixel]) {
+                *out = (pair_t){ pixel, stream->freq[pixel] };
+                return true;
+            }
+        }
+        return false;
+    }
+
+    if (stream->heap_size == 0) return false;
+    *out = (pair_t){ run_head(stream->heap[0]), 0 };
+
+    /* The same color may sit at the head of several runs. */
+    while (stream->heap_size && run_head(stream->heap[0]) == out->first) {
+        run_cursor_t *run = stream->heap[0];
+        out->second = add_saturated(out->second, run->buf[run->pos].second);
+        run->pos++;
+        if (!run_fill(run, &stream->failed)) {
+            if (stream->failed) {
+                stream->heap_size = 0;
+                return false;
+            }
+            stream->heap[0] = stream->heap[--stream->heap_size];
+        }
+        heap_down(stream, 0);
+    }
+    return true;
+}
+
+bool color_stream_rewind(color_stream_t *stream) {
+    if (stream->freq) {
+        stream->next = 0;
+        return true;
+    }
+
+    stream->heap_size = 0;
+    for (size_t i = 0; i < stream->run_count; i++) {
+        run_cursor_t *run = &stream->runs[i];
+        run->mem = run->mem_start;
+        run->offset = run->start;
+        run->remaining = run->length;
+        run->pos = run->len = 0;
+        if (run_fill(run, &stream->failed)) stream->heap[stream->heap_size++] = run;
+    }
+    if (stream->failed) {
+        stream->heap_size = 0;
+        return false;
+    }
+    for (size_t i = stream->heap_size; i-- > 0;) heap_down(stream, i);
+    return true;
+}
+
+void color_stream_free(color_stream_t *stream) {
+    free(stream->runs);
+    free(stream->heap);
+    if (stream->spill) fclose(stream->spill);
+    memset(stream, 0, sizeof(*stream));
+}
@@ -0,0 +1,92 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "cpu.h"
+#include "helper.h"
+
+#define HISTOGRAM_SIZE 0x1000000
+
+/* Dense count of every 24-bit color. */
+typedef struct {
+    uint32_t *freq;
+    size_t color_count;
+    uint64_t pixel_count;
+} histogram_t;
+
+/* Sparse open-addressing rgb -> count table, cheap enough to give one to
+ * every worker thread and merge afterwards. With a `max_size` it never
+ * grows past that many colors: when full, its content is written as a
+ * sorted run to a temporary file and the table starts over. */
+typedef struct {
+    pair_t *slots;
+    size_t capacity;
+    size_t size;
+    size_t max_size;
+    uint64_t pixel_count;
+
+    FILE *spill;
+    uint64_t *run_lengths;
+    size_t run_count;
+} color_table_t;
+
+/* Yields every distinct color once, in increasing rgb order, either from
+ * a dense histogram or by merging color tables and their spilled runs.
+ * `failed` is set when a spilled run could not be read back: the stream
+ * then ends early, its counts are short and the result must not be used. */
+typedef struct run_cursor run_cursor_t;
+typedef struct {
+    const uint32_t *freq;
+    uint32_t next;
+
+    run_cursor_t *runs;
+    run_cursor_t **heap;
+    size_t heap_size;
+    size_t run_count;
+    FILE *spill; /* runs merged ahead of time, see color_stream_merge() */
+    bool failed;
+} color_stream_t;
+
+#if defined(__x86_64__)
+#define HISTOGRAM_UNPACK_LEVELS (CPU_BIT(CPU_SSE2) | CPU_BIT(CPU_AVX2) | CPU_BIT(CPU_AVX512))
+#define HISTOGRAM_HASH_LEVELS   (CPU_BIT(CPU_SSE41) | CPU_BIT(CPU_AVX2) | CPU_BIT(CPU_AVX512))
+#else
+#define HISTOGRAM_UNPACK_LEVELS 0
+#define HISTOGRAM_HASH_LEVELS   0
+#endif
+
+/* RGBA bytes -> packed rgb, and the color table hash of packed colors. */
+void unpack_rgba(const uint8_t *rgba, rgb_t *out, size_t count);
+void hash_rgb(const rgb_t *rgb, uint32_t *hash, size_t count);
+
+bool histogram_init(histogram_t *hist);
+void histogram_add_rgba(histogram_t *hist, const uint8_t *pixels, size_t count);
+void histogram_merge_table(histogram_t *hist, const color_table_t *table);
+/* The same with atomic adds, for workers counting into one histogram at
+ * once; color_count and pixel_count are left as they are. */
+void histogram_add_rgba_shared(histogram_t *hist, const uint8_t *pixels, size_t count);
+void histogram_merge_table_shared(histogram_t *hist, const color_table_t *table);
+void histogram_free(histogram_t *hist);
+
+bool color_table_init(color_table_t *table, size_t capacity, size_t max_size);
+bool color_table_add_rgba(color_table_t *table, const uint8_t *pixels, size_t count);
+void color_table_free(color_table_t *table);
+
+void color_stream_dense(color_stream_t *stream, const histogram_t *hist);
+/* Sorts the tables in place, they can only be freed afterwards. Each run
+ * read at once takes a cursor with its own buffer: when those would pass
+ * `max_bytes` (0: no limit), the spilled runs are first merged a group at
+ * a time into longer runs of another temporary file, as many passes as it
+ * takes. */
+bool color_stream_merge(color_stream_t *stream, color_table_t *tables, size_t count, size_t max_bytes);
+bool color_stream_next(color_stream_t *stream, pair_t *out);
+/* Back to the first color, false (and `failed` set) when a spilled run
+ * can not be read back. */
+bool color_stream_rewind(color_stream_t *stream);
+void color_stream_free(color_stream_t *stream);
+
+#endif /* HISTOGRAM_H */
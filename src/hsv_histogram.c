@@ -0,0 +1,87 @@
+#include <stdlib.h>
+
+#include "hsv_histogram.h"
+#include "filter.h"
+#include "config.h"
+
+static uint32_t cell_axis(float x, uint32_t size) {
+    uint32_t i = (uint32_t)(x * size);
+    return i < size ? i : size - 1;
+}
+
+static bool hsv_histogram_batch(void *user, const engine_batch_t *batch) {
+    hsv_histogram_t *hist = user;
+    for (size_t i = 0; i < batch->count; i++) {
+        uint32_t index = (cell_axis(batch->h[i], HSV_HIST_H) * HSV_HIST_S + cell_axis(batch->s[i], HSV_HIST_S)) *
+                         HSV_HIST_V + cell_axis(batch->v[i], HSV_HIST_V);
+        hsv_cell_t *cell = &hist->cells[index];
+        cell->count += batch->pixels[i];
+        /* In stream order, a tie keeps the lower rgb. */
+        if (batch->pixels[i] > cell->rgb_count) {
+            cell->rgb = batch->rgb[i];
+            cell->rgb_count = batch->pixels[i];
+        }
+    }
+    return true;
+}
+
+bool hsv_histogram_build(hsv_histogram_t *hist, color_stream_t *colors) {
+    *hist = (hsv_histogram_t){0};
+    hist->cells = calloc(HSV_HIST_BINS, sizeof(hsv_cell_t));
+    if (!hist->cells) {
+        fprintf(stderr, "ERROR: Out of memory!\n");
+        return false;
+    }
+
+    if (!engine_stream_batches(colors, ENGINE_BATCH_HSV, false, &hist->most_used, hsv_histogram_batch, hist)) {
+        hsv_histogram_free(hist);
+        return false;
+    }
+    return true;
+}
+
+void hsv_histogram_free(hsv_histogram_t *hist) {
+    free(hist->cells);
+    *hist = (hsv_histogram_t){0};
+}
+
+static pair_t cell_pair(const hsv_cell_t *cell) {
+    return (pair_t){ cell->rgb, cell->count > UINT32_MAX ? UINT32_MAX : (uint32_t)cell->count };
+}
+
+static bool cell_beats(const hsv_cell_t *a, const hsv_cell_t *b) {
+    return !b || a->count > b->count || (a->count == b->count && a->rgb < b->rgb);
+}
+
+void hsv_histogram_accents(const hsv_histogram_t *hist, engine_limits_t limits, bool monochrome,
+                           accents_t *out) {
+    *out = (accents_t){0};
+    out->most_used = hist->most_used;
+
+    hsv_filter_t filter;
+    hsv_filter_init(&filter, limits.min_v, limits.max_v, limits.min_s, limits.max_s);
+
+    const hsv_cell_t *first = NULL;
+    for (size_t i = 0; i < HSV_HIST_BINS; i++) {
+        const hsv_cell_t *cell = &hist->cells[i];
+        if (!cell->count || !hsv_filter_accepts(&filter, cell->rgb)) continue;
+        engine_offer(out, cell_pair(cell));
+        if (cell_beats(cell, first)) first = cell;
+    }
+    if (!first) return;
+    out->first = cell_pair(first);
+    out->found = true;
+    if (monochrome) return;
+
+    /* OKLab only for the cells that would win, few of them. */
+    oklab_t first_lab = rgb_to_oklab(first->rgb);
+    float min_dist2 = second_color_oklab_diff * second_color_oklab_diff;
+    const hsv_cell_t *second = NULL;
+    for (size_t i = 0; i < HSV_HIST_BINS; i++) {
+        const hsv_cell_t *cell = &hist->cells[i];
+        if (!cell->count || cell == first || !cell_beats(cell, second)) continue;
+        if (!hsv_filter_accepts(&filter, cell->rgb)) continue;
+        if (color_oklab_distance2(rgb_to_oklab(cell->rgb), first_lab) >= min_dist2) second = cell;
+    }
+    if (second) out->second = cell_pair(second);
+}
@@ -0,0 +1,44 @@
+#ifndef HSV_HISTOGRAM_H
+#define HSV_HISTOGRAM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "engine.h"
+#include "histogram.h"
+
+/* The distinct colors of an image folded into 64 hue x 32 saturation x 32
+ * value cells (1 MB), each with its pixel count and its most used color
+ * as representative. Built once from a color stream, it then answers the
+ * accents for any value / saturation window by reading the cells only,
+ * in well under a millisecond, so one scan serves several windows.
+ *
+ * A cell belongs to the window when its representative does, colors of a
+ * cell that straddles a threshold are counted with their representative. */
+#define HSV_HIST_H    64
+#define HSV_HIST_S    32
+#define HSV_HIST_V    32
+#define HSV_HIST_BINS (HSV_HIST_H * HSV_HIST_S * HSV_HIST_V)
+
+typedef struct {
+    uint64_t count;
+    rgb_t rgb;
+    uint32_t rgb_count;
+} hsv_cell_t;
+
+typedef struct {
+    hsv_cell_t *cells;
+    /* The most used color overall, for the monochrome fallback. */
+    pair_t most_used;
+} hsv_histogram_t;
+
+/* Reads `colors` to the end. */
+bool hsv_histogram_build(hsv_histogram_t *hist, color_stream_t *colors);
+void hsv_histogram_free(hsv_histogram_t *hist);
+
+/* The heaviest cell in the window, then the heaviest one far enough from
+ * it in OKLab, as their representatives and cell counts. */
+void hsv_histogram_accents(const hsv_histogram_t *hist, engine_limits_t limits, bool monochrome,
+                           accents_t *out);
+
+#endif /* HSV_HISTOGRAM_H */
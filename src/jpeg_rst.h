@@ -0,0 +1,316 @@
+#ifndef JPEG_RST_H
+#define JPEG_RST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Called from the worker threads with one decoded RGBA row. `worker` is
+ * below parallel_thread_count() and never shared by two running threads. */
+typedef void (*jpeg_rst_row_fn)(void *user, size_t worker, const unsigned char *rgba, int width, int y);
+
+/* Decode a baseline JPEG that carries restart markers (DRI) in parallel.
+ * Every restart interval can be entropy decoded on its own, so the image is
+ * cut in strips of MCU rows and each strip is decoded, upsampled and color
+ * converted on its own thread into a small strip-sized buffer. No full
+ * image buffer is ever allocated; with a non-zero `mem_budget` (bytes) the
+ * strips are made short enough for all threads' buffers to fit in it.
+ *
+ * Returns false when the file is not eligible (no restart markers,
+ * progressive, not 3 components, ...) or is corrupt; rows may already have
+ * been delivered in the latter case, so the caller must drop them. */
+bool jpeg_rst_decode(const unsigned char *buffer, size_t len, size_t mem_budget,
+                     int *width, int *height, jpeg_rst_row_fn fn, void *user);
+
+#ifdef JPEG_RST_IMPLEMENTATION
+
+#ifndef STB_IMAGE_IMPLEMENTATION
+#error "jpeg_rst.h needs the stb_image implementation in the same translation unit"
+#endif
+
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#include "parallel.h"
+
+typedef struct {
+    const stbi__jpeg *z;
+    const unsigned char **interval_start;
+    const unsigned char **interval_end;
+    size_t interval_count;
+    int mcu_count;
+    int strip_rows;
+    bool is_rgb;
+    jpeg_rst_row_fn fn;
+    void *user;
+    atomic_bool failed;
+} jpeg_rst_job_t;
+
+/* Entropy decode the intervals touching MCU rows [row0, row1) and IDCT the
+ * blocks inside that range into the strip planes. */
+static bool jpeg_rst_decode_rows(jpeg_rst_job_t *job, stbi__jpeg *j, int row0, int row1, stbi_uc **planes) {
+    const stbi__jpeg *z = job->z;
+    int ri = z->restart_interval;
+    int first_mcu = row0 * z->img_mcu_x;
+    int last_mcu  = row1 * z->img_mcu_x;
+    STBI_SIMD_ALIGN(short, data[64]);
+
+    for (size_t k = first_mcu / ri; k < job->interval_count && (int)(k * ri) < last_mcu; k++) {
+        stbi__context s;
+        stbi__start_mem(&s, job->interval_start[k], (int)(job->interval_end[k] - job->interval_start[k]));
+        j->s = &s;
+        stbi__jpeg_reset(j);
+
+        int end = (int)(k + 1) * ri;
+        if (end > job->mcu_count) end = job->mcu_count;
+        if (end > last_mcu) end = last_mcu;
+
+        for (int m = (int)k * ri; m < end; m++) {
+            int mx = m % z->img_mcu_x;
+            int my = m / z->img_mcu_x;
+            bool keep = m >= first_mcu;
+            for (int c = 0; c < z->scan_n; c++) {
+                int n = z->order[c];
+                int w2 = z->img_comp[n].w2;
+                for (int y = 0; y < z->img_comp[n].v; y++) {
+                    for (int x = 0; x < z->img_comp[n].h; x++) {
+                        int ha = j->img_comp[n].ha;
+                        if (!stbi__jpeg_decode_block(j, data, j->huff_dc + j->img_comp[n].hd, j->huff_ac + ha,
+                                                     j->fast_ac[ha], n, j->dequant[j->img_comp[n].tq])) {
+                            return false;
+                        }
+                        if (!keep) continue;
+                        int x2 = (mx * z->img_comp[n].h + x) * 8;
+                        int y2 = ((my - row0) * z->img_comp[n].v + y) * 8;
+                        j->idct_block_kernel(planes[n] + (size_t)w2 * y2 + x2, w2, data);
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+static void jpeg_rst_strip(void *ctx, size_t index, size_t worker) {
+    jpeg_rst_job_t *job = ctx;
+    const stbi__jpeg *z = job->z;
+    if (atomic_load(&job->failed)) return;
+
+    int row0 = (int)index * job->strip_rows;
+    int row1 = row0 + job->strip_rows;
+    if (row1 > z->img_mcu_y) row1 = z->img_mcu_y;
+
+    /* One MCU row of halo on each side feeds the vertical upsampler. */
+    int dec0 = (row0 > 0) ? row0 - 1 : 0;
+    int dec1 = (row1 < z->img_mcu_y) ? row1 + 1 : row1;
+
+    stbi__jpeg *j = malloc(sizeof(stbi__jpeg));
+    stbi_uc *planes[3] = {0};
+    stbi_uc *linebuf[3] = {0};
+    stbi_uc *out = malloc((size_t)z->s->img_x * 4);
+    bool ok = j && out;
+
+    for (int k = 0; ok && k < 3; k++) {
+        size_t rows = (size_t)(dec1 - dec0) * z->img_comp[k].v * 8;
+        planes[k]  = malloc(rows * z->img_comp[k].w2);
+        linebuf[k] = malloc(z->s->img_x + 3);
+        ok = planes[k] && linebuf[k];
+    }
+
+    if (ok) {
+        *j = *z;
+        ok = jpeg_rst_decode_rows(job, j, dec0, dec1, planes);
+    }
+
+    if (ok) {
+        resample_row_func resample[3];
+        int hs[3], vs[3], w_lores[3], ystep[3], ypos[3], line0[3], line1[3];
+
+        for (int k = 0; k < 3; k++) {
+            hs[k] = z->img_h_max / z->img_comp[k].h;
+            vs[k] = z->img_v_max / z->img_comp[k].v;
+            w_lores[k] = (z->s->img_x + hs[k] - 1) / hs[k];
+            ystep[k] = vs[k] >> 1;
+            ypos[k] = line0[k] = line1[k] = 0;
+
+            if      (hs[k] == 1 && vs[k] == 1) resample[k] = resample_row_1;
+            else if (hs[k] == 1 && vs[k] == 2) resample[k] = stbi__resample_row_v_2;
+            else if (hs[k] == 2 && vs[k] == 1) resample[k] = stbi__resample_row_h_2;
+            else if (hs[k] == 2 && vs[k] == 2) resample[k] = z->resample_row_hv_2_kernel;
+            else                               resample[k] = stbi__resample_row_generic;
+        }
+
+        int y0 = row0 * z->img_mcu_h;
+        int y1 = row1 * z->img_mcu_h;
+        if (y1 > (int)z->s->img_y) y1 = z->s->img_y;
+
+        /* Same line stepping as stb's load_jpeg_image(), fast-forwarded to
+         * the first row of this strip. */
+        for (int y = 0; y < y1; y++) {
+            stbi_uc *coutput[3];
+            for (int k = 0; k < 3; k++) {
+                if (y >= y0) {
+                    int base = dec0 * z->img_comp[k].v * 8;
+                    int w2 = z->img_comp[k].w2;
+                    bool y_bot = ystep[k] >= (vs[k] >> 1);
+                    stbi_uc *near = planes[k] + (size_t)((y_bot ? line1[k] : line0[k]) - base) * w2;
+                    stbi_uc *far  = planes[k] + (size_t)((y_bot ? line0[k] : line1[k]) - base) * w2;
+                    coutput[k] = resample[k](linebuf[k], near, far, w_lores[k], hs[k]);
+                }
+                if (++ystep[k] >= vs[k]) {
+                    ystep[k] = 0;
+                    line0[k] = line1[k];
+                    if (++ypos[k] < z->img_comp[k].y) line1[k]++;
+                }
+            }
+            if (y < y0) continue;
+
+            if (job->is_rgb) {
+                for (unsigned int i = 0; i < z->s->img_x; i++) {
+                    out[i * 4 + 0] = coutput[0][i];
+                    out[i * 4 + 1] = coutput[1][i];
+                    out[i * 4 + 2] = coutput[2][i];
+                    out[i * 4 + 3] = 255;
+                }
+            } else {
+                z->YCbCr_to_RGB_kernel(out, coutput[0], coutput[1], coutput[2], z->s->img_x, 4);
+            }
+            job->fn(job->user, worker, out, z->s->img_x, y);
+        }
+    }
+
+    if (!ok) atomic_store(&job->failed, true);
+    for (int k = 0; k < 3; k++) {
+        free(planes[k]);
+        free(linebuf[k]);
+    }
+    free(out);
+    free(j);
+}
+
+/* Record where every restart interval of the scan starting at `p` begins
+ * and ends. Returns false unless the scan is followed by EOI. */
+static bool jpeg_rst_find_intervals(const unsigned char *p, const unsigned char *end,
+                                    const unsigned char **starts, const unsigned char **ends,
+                                    size_t expected) {
+    size_t count = 0;
+    starts[count] = p;
+    while (p + 1 < end) {
+        if (p[0] != 0xFF || p[1] == 0x00 || p[1] == 0xFF) {
+            p++;
+            continue;
+        }
+        if (!STBI__RESTART(p[1])) {
+            ends[count] = p + 2;
+            return count + 1 == expected && stbi__EOI(p[1]);
+        }
+        ends[count] = p + 2;
+        if (++count >= expected) return false;
+        starts[count] = p + 2;
+        p += 2;
+    }
+    return false;
+}
+
+bool jpeg_rst_decode(const unsigned char *buffer, size_t len, size_t mem_budget,
+                     int *width, int *height, jpeg_rst_row_fn fn, void *user) {
+    if (len > 0x7FFFFFFF) return false;
+
+    stbi__context s;
+    stbi__start_mem(&s, buffer, (int)len);
+
+    stbi__jpeg *z = malloc(sizeof(stbi__jpeg));
+    if (!z) return false;
+    z->s = &s;
+    stbi__setup_jpeg(z);
+    z->restart_interval = 0;
+
+    bool ok = stbi__decode_jpeg_header(z, STBI__SCAN_header) && !z->progressive && s.img_n == 3;
+
+    int m = ok ? stbi__get_marker(z) : STBI__MARKER_none;
+    while (ok && !stbi__SOS(m)) {
+        ok = !stbi__EOI(m) && !stbi__DNL(m) && stbi__process_marker(z, m);
+        m = stbi__get_marker(z);
+    }
+    ok = ok && stbi__process_scan_header(z) && z->scan_n == 3 && z->restart_interval > 0;
+
+    int h_max = 1, v_max = 1;
+    for (int i = 0; ok && i < 3; i++) {
+        if (z->img_comp[i].h > h_max) h_max = z->img_comp[i].h;
+        if (z->img_comp[i].v > v_max) v_max = z->img_comp[i].v;
+    }
+    for (int i = 0; ok && i < 3; i++) {
+        ok = (h_max % z->img_comp[i].h == 0) && (v_max % z->img_comp[i].v == 0);
+    }
+
+    const unsigned char **starts = NULL;
+    const unsigned char **ends = NULL;
+    size_t interval_count = 0;
+
+    if (ok) {
+        /* Mirrors the SCAN_load branch of stbi__process_frame_header(),
+         * minus the full size component planes. */
+        z->img_h_max = h_max;
+        z->img_v_max = v_max;
+        z->img_mcu_w = h_max * 8;
+        z->img_mcu_h = v_max * 8;
+        z->img_mcu_x = (s.img_x + z->img_mcu_w - 1) / z->img_mcu_w;
+        z->img_mcu_y = (s.img_y + z->img_mcu_h - 1) / z->img_mcu_h;
+        for (int i = 0; i < 3; i++) {
+            z->img_comp[i].x = (s.img_x * z->img_comp[i].h + h_max - 1) / h_max;
+            z->img_comp[i].y = (s.img_y * z->img_comp[i].v + v_max - 1) / v_max;
+            z->img_comp[i].w2 = z->img_mcu_x * z->img_comp[i].h * 8;
+            z->img_comp[i].h2 = z->img_mcu_y * z->img_comp[i].v * 8;
+        }
+
+        size_t mcu_count = (size_t)z->img_mcu_x * z->img_mcu_y;
+        interval_count = (mcu_count + z->restart_interval - 1) / z->restart_interval;
+        starts = malloc(interval_count * sizeof(*starts));
+        ends   = malloc(interval_count * sizeof(*ends));
+        ok = interval_count > 1 && starts && ends &&
+             jpeg_rst_find_intervals(s.img_buffer, s.img_buffer_end, starts, ends, interval_count);
+    }
+
+    if (ok) {
+        jpeg_rst_job_t job = {
+            .z = z,
+            .interval_start = starts,
+            .interval_end = ends,
+            .interval_count = interval_count,
+            .mcu_count = z->img_mcu_x * z->img_mcu_y,
+            .is_rgb = z->rgb == 3 || (z->app14_color_transform == 0 && !z->jfif),
+            .fn = fn,
+            .user = user,
+        };
+        atomic_init(&job.failed, false);
+
+        /* A few strips per thread for balance, but never shorter than one
+         * restart interval so intervals are not re-decoded too often. */
+        int interval_rows = (z->restart_interval + z->img_mcu_x - 1) / z->img_mcu_x;
+        size_t target = parallel_thread_count() * 4;
+        job.strip_rows = (int)((z->img_mcu_y + target - 1) / target);
+        if (job.strip_rows < interval_rows) job.strip_rows = interval_rows;
+
+        if (mem_budget) {
+            size_t mcu_row_bytes = 0;
+            for (int i = 0; i < 3; i++) mcu_row_bytes += (size_t)z->img_comp[i].v * 8 * z->img_comp[i].w2;
+            size_t fit = mem_budget / (parallel_thread_count() * mcu_row_bytes);
+            fit = (fit > 3) ? fit - 2 : 1; /* halo rows */
+            if ((size_t)job.strip_rows > fit) job.strip_rows = (int)fit;
+        }
+
+        size_t strips = (z->img_mcu_y + job.strip_rows - 1) / job.strip_rows;
+        parallel_for(strips, jpeg_rst_strip, &job);
+        ok = !atomic_load(&job.failed);
+
+        *width = s.img_x;
+        *height = s.img_y;
+    }
+
+    free(starts);
+    free(ends);
+    free(z);
+    return ok;
+}
+
+#endif /* JPEG_RST_IMPLEMENTATION */
+#endif /* JPEG_RST_H */
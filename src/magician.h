@@ -5,10 +5,20 @@
 #include <stdio.h>
 #include <string.h>
 
+typedef enum {
+    FORMAT_UNKNOWN,
+    FORMAT_PNG,
+    FORMAT_JPEG,
+    FORMAT_GIF,
+} format_e;
+
 bool is_png(FILE *f);
 bool is_jpeg(FILE *f);
 bool is_bmp(FILE *f);
 bool is_gif(FILE *f);
+format_e detect_format(FILE *f);
+format_e detect_format_memory(const unsigned char *buffer, size_t len);
+const char *format_to_str(format_e format);
 
 #ifdef MAGICIAN_IMPLEMENTATION
 
@@ -39,5 +49,31 @@ bool is_gif(FILE *f) {
            readn_and_match(f, sizeof(gif89a), gif89a);
 }
 
+format_e detect_format(FILE *f) {
+    if (is_png(f)) return FORMAT_PNG;
+    if (is_jpeg(f)) return FORMAT_JPEG;
+    if (is_gif(f)) return FORMAT_GIF;
+    return FORMAT_UNKNOWN;
+}
+
+format_e detect_format_memory(const unsigned char *buffer, size_t len) {
+    const unsigned char png[] = {137,80,78,71,13,10,26,10};
+    const unsigned char jpeg[] = {255, 216, 255};
+    const unsigned char gif[] = {71, 73, 70, 56};
+    if (len >= sizeof(png) && memcmp(buffer, png, sizeof(png)) == 0) return FORMAT_PNG;
+    if (len >= sizeof(jpeg) && memcmp(buffer, jpeg, sizeof(jpeg)) == 0) return FORMAT_JPEG;
+    if (len >= sizeof(gif) && memcmp(buffer, gif, sizeof(gif)) == 0) return FORMAT_GIF;
+    return FORMAT_UNKNOWN;
+}
+
+const char *format_to_str(format_e format) {
+    switch (format) {
+    case FORMAT_PNG:  return "png";
+    case FORMAT_JPEG: return "jpeg";
+    case FORMAT_GIF:  return "gif";
+    default:          return "unknown";
+    }
+}
+
 #endif /* MAGICIAN_IMPLEMENTATION */
 #endif /* MAGICIAN_H */
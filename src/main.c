@@ -1,156 +1,388 @@
-#define STB_IMAGE_IMPLEMENTATION
 #define MAGICIAN_IMPLEMENTATION
+#define CPU_IMPLEMENTATION
 
 #include <errno.h>
+#include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-#include "stb_image.h"
 #include "magician.h"
+#include "cpu.h"
+#include "decoder.h"
+#include "exif.h"
 #include "helper.h"
+#include "engine.h"
+#include "histogram.h"
+#include "parallel.h"
+#include "selftest.h"
+#include "contrast.h"
 #include "config.h"
 #include "version.h"
 
 #define MIN_ARGS 3
 #define DEFAULT_SIZE 512
+#define PREVIEW_SIDE 256
 
-int main(int argc, char **argv) {
-    /* -- Opening -- */
-    bool monochrome = false;
-    bool dark_mode = true;
+static unsigned char *map_file(FILE *f, size_t *size) {
+    struct stat st;
+    if (fstat(fileno(f), &st) != 0 || st.st_size <= 0) return NULL;
 
-    char *target = NULL;
-    char *input = NULL;
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+    if (data == MAP_FAILED) return NULL;
+    *size = st.st_size;
+    return data;
+}
 
-    bool exit_mode = false;
-    for (int i = 1; i < argc; i++) {
-        char *current = argv[i];
-        if (current[0] == '-') {
-            if (strlen(current) < 2) continue; // need minimal `-[a]` so min 2
-            switch (current[1]) {
-            case 'h':
-                printf("%s [infile] [outfile]\n", argv[0]);
-                exit_mode = true;
-                break;
-            case 'v':
-                printf("%s %d.%d.%d\n", argv[0], VERSION_MAJOR, VERSION_MINOR, VERSION_PATCH);
-                exit_mode = true;
-                break;
-            case 'l':
-                dark_mode = false;
-                break;
-            case 'm':
-                monochrome = true;
-                break;
-            default:
-                fprintf(stderr, "ERROR: Not a valid argument!\n");
-                break;
-            }
-        } else {
-            if (!input) input = current;
-            else if (!target) target = current;
-            else continue;
-        }
-    }
-    if (!exit_mode && (!input || !target)) {
-        fprintf(stderr, "ERROR: Not enought argument!\n");
-        return 1;
+/* "--name value" or "--name=value" */
+static const char *long_arg_value(int argc, char **argv, int *i, const char *name) {
+    size_t len = strlen(name);
+    const char *current = argv[*i];
+    if (strncmp(current, name, len) != 0) return NULL;
+    if (current[len] == '=') return current + len + 1;
+    if (current[len] == '\0' && *i + 1 < argc) return argv[++*i];
+    return NULL;
+}
+
+/* Plain bytes or with a K/M/G suffix. */
+static bool parse_size(const char *str, size_t *out) {
+    char *end;
+    unsigned long long value = strtoull(str, &end, 10);
+    if (end == str) return false;
+    switch (*end) {
+    case 'k': case 'K': value <<= 10; end++; break;
+    case 'm': case 'M': value <<= 20; end++; break;
+    case 'g': case 'G': value <<= 30; end++; break;
+    default: break;
     }
+    if (*end != '\0') return false;
+    *out = value;
+    return true;
+}
 
-    if (exit_mode) return 0;
+/* "<min>:<max>", both within [0, 1]. */
+static bool parse_range(const char *str, float *min, float *max) {
+    char *end;
+    float low = strtof(str, &end);
+    if (end == str || *end != ':') return false;
+    const char *rest = end + 1;
+    float high = strtof(rest, &end);
+    if (end == rest || *end != '\0') return false;
+    if (!(low >= 0.0f && low <= high && high <= 1.0f)) return false;
+    *min = low;
+    *max = high;
+    return true;
+}
 
-    FILE *in_file = fopen(argv[1], "rb");
-    if (!in_file) {
-        fprintf(stderr, "ERROR: Failed to open the file: %s\n", strerror(errno));
-        return 1;
+/* Streamed rows go to one color table per worker. With `fold_at` set, a
+ * table past that many colors is folded into the dense histogram, which
+ * its worker then counts into, shared with the other workers. */
+typedef struct {
+    color_table_t *tables;
+    histogram_t *hist;
+    size_t fold_at;
+    bool folded[PARALLEL_MAX_THREADS];
+} count_job_t;
+
+static void count_row(void *user, size_t worker, const unsigned char *rgba, int width, int y) {
+    (void)y;
+    count_job_t *job = user;
+    if (job->folded[worker]) {
+        histogram_add_rgba_shared(job->hist, rgba, width);
+        return;
     }
 
-    if (!is_png(in_file) && !is_jpeg(in_file)) {
-        fprintf(stderr, "ERROR: File `%s` is not a png or jpeg file!\n", argv[1]);
-        return 1;
+    color_table_t *table = &job->tables[worker];
+    /* On allocation failure the count is simply short, it is a palette. */
+    color_table_add_rgba(table, rgba, width);
+    if (job->fold_at && table->size > job->fold_at) {
+        histogram_merge_table_shared(job->hist, table);
+        color_table_free(table);
+        job->folded[worker] = true;
     }
+}
 
-    int width, height, n;
-    unsigned char *image = stbi_load_from_file(in_file, &width, &height, &n, 4);
-    if (!image) {
-        fprintf(stderr, "ERROR: Failed to parse file `%s`: %s\n", argv[1], stbi_failure_reason());
-        return 1;
+static bool init_tables(color_table_t *tables, size_t count, size_t max_size) {
+    /* Never start above the cap, a small --max-mem would be over it
+     * before the first pixel. */
+    size_t initial = 1 << 16;
+    if (max_size && max_size < initial) initial = max_size;
+    for (size_t i = 0; i < count; i++) {
+        if (!color_table_init(&tables[i], initial, max_size)) return false;
     }
+    return true;
+}
 
-    /* Don't need it anymore goodbye! */
-    fclose(in_file);
+static void free_tables(color_table_t *tables, size_t count) {
+    for (size_t i = 0; i < count; i++) color_table_free(&tables[i]);
+}
+
+typedef struct {
+    const engine_t *engine;
+    void *state;
+} engine_feed_t;
 
-    /* -- Work -- */
+static void engine_row(void *user, size_t worker, const unsigned char *rgba, int width, int y) {
+    (void)y;
+    engine_feed_t *feed = user;
+    feed->engine->add_rgba(feed->state, worker, rgba, width);
+}
 
-    pair_t most_used    = {0};
-    pair_t second_used  = {0};
+#define FEED_BLOCK (1 << 16)
+#define SORTED_MERGE_MAX (1 << 18)
 
-    pair_t most_used_of_all_dont_care_criteria = {0};
+typedef struct {
+    engine_feed_t *feed;
+    const unsigned char *image;
+    size_t pixels;
+} image_feed_t;
 
-    bool found = false;
+static void engine_block(void *user, size_t index, size_t worker) {
+    image_feed_t *job = user;
+    size_t start = index * FEED_BLOCK;
+    size_t count = job->pixels - start < FEED_BLOCK ? job->pixels - start : FEED_BLOCK;
+    job->feed->engine->add_rgba(job->feed->state, worker, job->image + start * 4, count);
+}
 
-    uint16_t *freq = calloc(0x1000000, sizeof(uint16_t));
+/* The thumbnail embedded in the EXIF data when there is one, otherwise
+ * the image decoded at a reduced scale. */
+static unsigned char *decode_preview(const decoder_t *decoder, const unsigned char *data, size_t size,
+                                     int *width, int *height) {
+    const unsigned char *thumb;
+    size_t thumb_size;
+    if (exif_thumbnail(data, size, &thumb, &thumb_size)) {
+        unsigned char *image = decoder->decode_full(thumb, thumb_size, width, height);
+        if (image) return image;
+    }
+    return decoder->decode_scaled(data, size, PREVIEW_SIDE, width, height);
+}
+
+/* Whether the image the fallback path decodes whole fits in `budget`
+ * bytes: for a preview the EXIF thumbnail when there is one, otherwise the
+ * full image, which a reduced decode may hold too (stb does). An image the
+ * decoder can not size passes, the decode reports it. */
+static bool decode_fits(const decoder_t *decoder, const unsigned char *data, size_t size, bool thumb,
+                        size_t budget) {
+    int width, height;
+    const unsigned char *thumb_data;
+    size_t thumb_size;
+    if (thumb && exif_thumbnail(data, size, &thumb_data, &thumb_size) &&
+            decoder->info(thumb_data, thumb_size, &width, &height)) {
+        return (uint64_t)width * height * 4 <= budget;
+    }
+    if (!decoder->info(data, size, &width, &height)) return true;
+    return (uint64_t)width * height * 4 <= budget;
+}
+
+static void report_no_fit(const decoder_t *decoder, bool thumb, const char *name) {
+    if (thumb) {
+        fprintf(stderr, "ERROR: The --thumb preview of `%s` does not fit in --max-mem!\n", name);
+    } else {
+        fprintf(stderr, "ERROR: `%s` can not be streamed by the %s decoder and does not fit in --max-mem!\n",
+                name, decoder->name);
+    }
+}
 
-    size_t color_count = 0;
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            int index = (y * width + x) * n;
+/* Count every pixel and open a stream over the distinct colors.
+ *
+ * When the decoder can stream the file, rows are counted straight into
+ * one color table per worker; otherwise the image is decoded whole.
+ * Without a memory cap the tables are merged into the dense histogram,
+ * and a streamed one is folded into it as soon as it passes its share of
+ * SORTED_MERGE_MAX colors, see count_row(), so the worst case is the
+ * histogram. With one (`max_mem` bytes), half of it goes to
+ * the decoder buffers and half to the tables, which spill sorted runs to
+ * temporary files when full and are merged from there, so the result is
+ * the same whatever the strip and spill layout was. With `thumb` only a
+ * preview of the image is counted, see decode_preview(). With `streamed`
+ * set, a file the decoder can not stream is left to the caller instead
+ * of decoded whole: true, nothing counted and `*streamed` false. */
+static bool count_colors(const unsigned char *data, size_t size, const decoder_t *decoder,
+                         size_t max_mem, bool thumb, const char *name,
+                         color_table_t *tables, histogram_t *hist, color_stream_t *colors, bool *streamed) {
+    size_t workers = parallel_thread_count();
+    size_t decode_budget = max_mem / 2;
+    size_t table_max = 0;
+    if (max_mem) {
+        /* Slots are 8 bytes and a table runs at most half full before a
+         * spill, rounded up to a power of two. */
+        table_max = max_mem / 2 / workers / 32;
+        if (table_max < 4096) table_max = 4096;
+    }
 
-            uint8_t r = image[index + 0];
-            uint8_t g = image[index + 1];
-            uint8_t b = image[index + 2];
+    if (!init_tables(tables, workers, table_max)) {
+        fprintf(stderr, "ERROR: Out of memory!\n");
+        return false;
+    }
 
-            rgb_t pixel = (r << 16) | (g << 8) | b;
+    /* The histogram is calloc'ed, it only takes memory once folded into. */
+    count_job_t job = { tables, hist, 0, {0} };
+    if (!max_mem && !thumb && decoder->decode_rows && histogram_init(hist)) {
+        job.fold_at = SORTED_MERGE_MAX / workers;
+    }
 
-            hsv_t hsv = rgb_to_hsv(pixel);
+    int width, height;
+    bool counted = !thumb && decoder->decode_rows &&
+                   decoder->decode_rows(data, size, decode_budget, &width, &height, count_row, &job);
+    bool dense = false;
+    for (size_t i = 0; i < workers; i++) dense = dense || job.folded[i];
+
+    if (streamed) {
+        *streamed = counted;
+        if (!counted) {
+            free_tables(tables, workers);
+            histogram_free(hist);
+            return true;
+        }
+    }
 
-            uint32_t count = ++freq[pixel];
-            if (count == 1) ++color_count;
+    if (!counted) {
+        /* A corrupt file may have been half counted, start over. */
+        free_tables(tables, workers);
+        histogram_free(hist);
+        if (!init_tables(tables, workers, table_max)) {
+            fprintf(stderr, "ERROR: Out of memory!\n");
+            return false;
+        }
 
-            if (count > most_used_of_all_dont_care_criteria.second) {
-                most_used_of_all_dont_care_criteria.first = pixel;
-                most_used_of_all_dont_care_criteria.second = count;
-            }
+        if (max_mem && !decode_fits(decoder, data, size, thumb, decode_budget)) {
+            report_no_fit(decoder, thumb, name);
+            free_tables(tables, workers);
+            return false;
+        }
 
-            // if (!monochrome) {
-                if (hsv.v < min_lightness || hsv.v > max_lightness ||
-                        hsv.s < min_saturation || hsv.s > max_saturation) {
-                    continue;
-                }
-            // } else {
-            //     if (hsv.v < 0.2 || hsv.v > 0.8 || hsv.s < 4.0 || hsv.s >= 0.0) {
-            //         continue;
-            //     }
-            // }
-
-            if (count > most_used.second) {
-                if (!found) found = true;
-                most_used.first = pixel;
-                most_used.second = count;
-            }
+        unsigned char *image = thumb ? decode_preview(decoder, data, size, &width, &height)
+                                     : decoder->decode_full(data, size, &width, &height);
+        if (!image) {
+            fprintf(stderr, "ERROR: Failed to parse file `%s`: %s\n", name, decoder->failure_reason());
+            free_tables(tables, workers);
+            return false;
+        }
 
-            if (!monochrome && count < most_used.second && count > second_used.second) {
-                hsv_t first_hsv = rgb_to_hsv(most_used.first);
+        if (max_mem) {
+            counted = color_table_add_rgba(&tables[0], image, (size_t)width * height);
+        } else {
+            counted = histogram_init(hist);
+            if (counted) histogram_add_rgba(hist, image, (size_t)width * height);
+            dense = counted;
+        }
 
-                // Compute circular hue distance
-                float hue_dist = fabs(hsv.h - first_hsv.h);
-                if (hue_dist > 0.5f) hue_dist = 1.0f - hue_dist;
+        /* Don't need it anymore goodbye! */
+        decoder->free_image(image);
+        if (!counted) {
+            fprintf(stderr, "ERROR: Out of memory!\n");
+            free_tables(tables, workers);
+            return false;
+        }
+    }
 
-                if (hue_dist >= second_color_hue_diff) {
-                    second_used.first = pixel;
-                    second_used.second = count;
-                }
-            }
+    /* A few distinct colors merge faster sorted than through the 64 MB
+     * dense histogram, which only pays off past about SORTED_MERGE_MAX. */
+    size_t distinct = 0;
+    for (size_t i = 0; i < workers; i++) distinct += tables[i].size;
+    if (max_mem || (!dense && distinct <= SORTED_MERGE_MAX)) {
+        histogram_free(hist);
+        if (!color_stream_merge(colors, tables, workers, decode_budget)) {
+            fprintf(stderr, "ERROR: Failed to merge the color tables!\n");
+            free_tables(tables, workers);
+            return false;
         }
+        return true;
     }
 
-    /* Don't need it anymore goodbye! */
-    stbi_image_free(image);
-    free(freq);
+    if (!hist->freq && !histogram_init(hist)) {
+        fprintf(stderr, "ERROR: Out of memory!\n");
+        free_tables(tables, workers);
+        return false;
+    }
+    for (size_t i = 0; i < workers; i++) histogram_merge_table(hist, &tables[i]);
+    free_tables(tables, workers);
+    color_stream_dense(colors, hist);
+    return true;
+}
 
-    if (!found && !monochrome) {
-        printf("INFO: There is not match color for the current criteria, activating monochrome mode automatically!\n");
+/* Hand every pixel to an engine that takes them itself (`begin` set),
+ * streaming rows like count_colors() does and without any histogram, or
+ * the whole image as many times as it asks for; `max_mem` then only
+ * bounds the decoder. Returns the engine state. */
+static void *feed_engine(const unsigned char *data, size_t size, const decoder_t *decoder,
+                         size_t max_mem, bool thumb, const char *name, const engine_t *engine) {
+    engine_feed_t feed = { engine, engine->begin(parallel_thread_count()) };
+    if (!feed.state) {
+        fprintf(stderr, "ERROR: Out of memory!\n");
+        return NULL;
+    }
+
+    /* Rows are gone once handed out, an engine that rescans gets the
+     * whole image decoded. */
+    int width, height;
+    if (!thumb && !engine->rescan && decoder->decode_rows &&
+            decoder->decode_rows(data, size, max_mem, &width, &height, engine_row, &feed)) {
+        return feed.state;
+    }
+
+    /* A corrupt file may have been half fed, start over. */
+    engine->end(feed.state);
+    feed.state = engine->begin(parallel_thread_count());
+    if (!feed.state) {
+        fprintf(stderr, "ERROR: Out of memory!\n");
+        return NULL;
+    }
+
+    if (max_mem && !decode_fits(decoder, data, size, thumb, max_mem)) {
+        report_no_fit(decoder, thumb, name);
+        engine->end(feed.state);
+        return NULL;
+    }
+
+    unsigned char *image = thumb ? decode_preview(decoder, data, size, &width, &height)
+                                 : decoder->decode_full(data, size, &width, &height);
+    if (!image) {
+        fprintf(stderr, "ERROR: Failed to parse file `%s`: %s\n", name, decoder->failure_reason());
+        engine->end(feed.state);
+        return NULL;
+    }
+    image_feed_t job = { &feed, image, (size_t)width * height };
+    do {
+        parallel_for((job.pixels + FEED_BLOCK - 1) / FEED_BLOCK, engine_block, &job);
+    } while (engine->rescan && engine->rescan(feed.state));
+    decoder->free_image(image);
+    return feed.state;
+}
+
+/* The 18 colors and the accents (accent1, accent2, ...) of one palette. */
+typedef struct {
+    rgb_t colors[18];
+    rgb_t accents[ACCENTS_MAX];
+    size_t accent_count;
+    /* No accent passed the window, monochrome was used instead. Left for
+     * the caller to report, generate_palette() may run on a worker. */
+    bool fell_back;
+} palette_t;
+
+typedef struct {
+    bool monochrome;
+    bool dark_mode;
+    size_t accent_count;
+    /* WCAG contrast every foreground color and accent keeps against
+     * color00 and color08, see contrast_solve(). */
+    float min_contrast;
+} palette_options_t;
+
+static void generate_palette(const accents_t *accents, palette_options_t options, palette_t *out) {
+    bool monochrome = options.monochrome;
+    bool dark_mode = options.dark_mode;
+    size_t accent_count = options.accent_count;
+    pair_t most_used   = accents->first;
+    pair_t second_used = accents->second;
+    bool found = accents->found;
+
+    out->fell_back = !found && !monochrome;
+    if (out->fell_back) {
         monochrome = true;
-        most_used = most_used_of_all_dont_care_criteria;
+        most_used = accents->most_used;
     }
 
     /* Generate the color */
@@ -176,7 +408,8 @@ int main(int argc, char **argv) {
      * 17: Same as 7 but lot more dark
      */
 
-    rgb_t palette[18] = {0}; /* 16 (+2 of slighly more black and white) */
+    rgb_t *palette = out->colors; /* 16 (+2 of slighly more black and white) */
+    memset(palette, 0, sizeof(out->colors));
 
     if (monochrome) {
         /* Get base color from the most used color */
@@ -394,27 +627,70 @@ int main(int argc, char **argv) {
         }
     }
 
-    /* -- Output the file -- */
-    FILE *out_file = fopen(argv[2], "w");
+    /* Past the second, the farthest apart of the engine's candidates, the
+     * first accent again where there are not enough. */
+    rgb_t more[ACCENTS_MAX];
+    size_t more_count = monochrome ? 0 : engine_more_accents(accents, accent_count, more);
+    size_t skip = accents->second.second ? 2 : 1;
+    out->accent_count = accent_count;
+    out->accents[0] = most_used.first;
+    out->accents[1] = second_used.first;
+    for (size_t i = 2; i < accent_count; i++) {
+        size_t from = skip + i - 2;
+        out->accents[i] = from < more_count ? more[from] : most_used.first;
+    }
+
+    /* Everything but the backgrounds (0, 8 and 16) is read on them. */
+    rgb_t backgrounds[2] = { palette[0], palette[8] };
+    contrast_backgrounds(backgrounds, 2, dark_mode, options.min_contrast);
+    palette[0] = backgrounds[0];
+    palette[8] = backgrounds[1];
+    rgb_t foregrounds[18 + ACCENTS_MAX];
+    size_t count = 0;
+    for (int i = 0; i < 18; i++) {
+        if (i != 0 && i != 8 && i != 16) foregrounds[count++] = palette[i];
+    }
+    for (size_t i = 0; i < accent_count; i++) foregrounds[count++] = out->accents[i];
+    contrast_solve(foregrounds, count, backgrounds, 2, options.min_contrast);
+    count = 0;
+    for (int i = 0; i < 18; i++) {
+        if (i != 0 && i != 8 && i != 16) palette[i] = foregrounds[count++];
+    }
+    for (size_t i = 0; i < accent_count; i++) out->accents[i] = foregrounds[count++];
+}
+
+static bool write_palette(const char *target, const palette_t *palette) {
+    FILE *out_file = fopen(target, "w");
     if (!out_file) {
         fprintf(stderr, "ERROR: Failed to open the file: %s\n", strerror(errno));
-        return 1;
+        return false;
     }
     fprintf(out_file, "return {\n");
     for(int i=0; i<18; i++) {
-        fprintf(out_file, "\tcolor%.2d = 0x%x,\n", i, palette[i]);
+        fprintf(out_file, "\tcolor%.2d = 0x%x,\n", i, palette->colors[i]);
+    }
+    for (size_t i = 0; i < palette->accent_count; i++) {
+        fprintf(out_file, "\taccent%zu = 0x%x%s\n", i + 1, palette->accents[i],
+                i + 1 < palette->accent_count ? "," : "");
     }
-    fprintf(out_file, "\taccent1 = 0x%x,\n", most_used.first);
-    fprintf(out_file, "\taccent2 = 0x%x\n", second_used.first);
     fprintf(out_file, "}\n");
 
     fclose(out_file);
+    return true;
+}
 
+static void print_fallback(const palette_t *palette) {
+    if (palette->fell_back) {
+        printf("INFO: There is not match color for the current criteria, activating monochrome mode automatically!\n");
+    }
+}
+
+static void print_palette(const palette_t *palette) {
     int printed = 0;
     for (int i = 0; i < 18; i++) {
-        uint8_t r = (palette[i] >> 16) & 0xFF;
-        uint8_t g = (palette[i] >> 8)  & 0xFF;
-        uint8_t b =  palette[i]        & 0xFF;
+        uint8_t r = (palette->colors[i] >> 16) & 0xFF;
+        uint8_t g = (palette->colors[i] >> 8)  & 0xFF;
+        uint8_t b =  palette->colors[i]        & 0xFF;
         printf("\033[48;2;%d;%d;%dm   \033[0m", r, g, b);
         printed++;
         if (printed >= 8) {
@@ -422,12 +698,534 @@ int main(int argc, char **argv) {
             printf("\n");
         }
     }
-    rgb_t accent_rgb = most_used.first;
+    rgb_t accent_rgb = palette->accents[0];
     uint8_t r = (accent_rgb >> 16) & 0xFF;
     uint8_t g = (accent_rgb >> 8)  & 0xFF;
     uint8_t b =  accent_rgb        & 0xFF;
     printf("\033[48;2;%d;%d;%dm   \033[0m", r, g, b);
     printf("\n");
+}
+
+/* -- Variants -- */
+
+typedef struct {
+    const char *name;
+    bool dark_mode;
+    bool monochrome;
+    bool colorful;
+} variant_t;
+
+static const variant_t variants[] = {
+    { "dark",     true,  false, false },
+    { "light",    false, false, false },
+    { "mono",     true,  true,  false },
+    { "colorful", true,  false, true  },
+};
+
+#define VARIANT_COUNT (sizeof(variants) / sizeof(variants[0]))
+
+/* "dark,light,..." into indices of `variants`, each once, in the order
+ * given. */
+static bool parse_variants(const char *str, size_t *picked, size_t *count) {
+    *count = 0;
+    while (*str) {
+        size_t len = strcspn(str, ",");
+        size_t found = VARIANT_COUNT;
+        for (size_t i = 0; i < VARIANT_COUNT; i++) {
+            if (strlen(variants[i].name) == len && strncmp(variants[i].name, str, len) == 0) found = i;
+        }
+        if (found == VARIANT_COUNT) {
+            fprintf(stderr, "ERROR: Unknown variant `%.*s`!\n", (int)len, str);
+            return false;
+        }
+        bool seen = false;
+        for (size_t i = 0; i < *count; i++) seen = seen || picked[i] == found;
+        if (!seen) picked[(*count)++] = found;
+        str += len;
+        if (*str == ',') str++;
+    }
+    if (*count == 0) fprintf(stderr, "ERROR: Empty --variants!\n");
+    return *count > 0;
+}
+
+/* Whether to hand the pixels to the engine rather than a color stream.
+ * The pixel path of an engine that has both holds no histogram but may
+ * hold the whole image, a memory cap goes through the stream. So do more
+ * than two accents: the pixel paths only settle what the first two need,
+ * the stream offers every color as a candidate. */
+static bool use_pixels(const engine_t *engine, size_t max_mem, size_t accent_count) {
+    return engine->begin && !(engine->pick && (max_mem || accent_count > 2));
+}
+
+/* A stream over the colors of an image held in memory, through `hist`,
+ * counted on first use and kept for the next call. */
+static bool image_colors(const unsigned char *image, size_t pixels, histogram_t *hist, color_stream_t *colors) {
+    if (!hist->freq) {
+        if (!histogram_init(hist)) {
+            fprintf(stderr, "ERROR: Out of memory!\n");
+            return false;
+        }
+        histogram_add_rgba(hist, image, pixels);
+    }
+    color_stream_dense(colors, hist);
+    return true;
+}
+
+/* The accents of an image held in memory, through the pixel path of the
+ * engine when it has one, otherwise through image_colors(). */
+static bool image_accents(const engine_t *engine, const unsigned char *image, size_t pixels,
+                          size_t accent_count, histogram_t *hist, accents_t *out) {
+    if (use_pixels(engine, 0, accent_count)) {
+        engine_feed_t feed = { engine, engine->begin(parallel_thread_count()) };
+        if (!feed.state) {
+            fprintf(stderr, "ERROR: Out of memory!\n");
+            return false;
+        }
+        image_feed_t job = { &feed, image, pixels };
+        do {
+            parallel_for((job.pixels + FEED_BLOCK - 1) / FEED_BLOCK, engine_block, &job);
+        } while (engine->rescan && engine->rescan(feed.state));
+        bool picked = engine->finish(feed.state, false, out);
+        engine->end(feed.state);
+        return picked;
+    }
+
+    color_stream_t colors;
+    if (!image_colors(image, pixels, hist, &colors)) return false;
+    bool picked = engine->pick(&colors, false, out);
+    color_stream_free(&colors);
+    return picked;
+}
+
+typedef struct {
+    const size_t *picked;
+    const accents_t *accents;
+    palette_options_t options;
+    palette_t *palettes;
+    char **targets;
+    bool *written;
+} variant_job_t;
+
+static void variant_generate(void *user, size_t index, size_t worker) {
+    (void)worker;
+    variant_job_t *job = user;
+    const variant_t *variant = &variants[job->picked[index]];
+    palette_options_t options = job->options;
+    options.monochrome = variant->monochrome;
+    options.dark_mode = variant->dark_mode;
+    generate_palette(&job->accents[variant->colorful], options, &job->palettes[index]);
+    job->written[index] = write_palette(job->targets[index], &job->palettes[index]);
+}
+
+/* Every variant in `picked` from one decode: the image stays in memory,
+ * the accents are picked once per accent window (the colorful one has
+ * its own) and the palettes are generated and written in parallel, each
+ * to `pattern` with its `%s` replaced by the variant name. */
+static bool run_variants(const unsigned char *data, size_t size, const decoder_t *decoder, bool thumb,
+                         const char *name, const engine_t *engine, palette_options_t options,
+                         const char *pattern, const size_t *picked, size_t count) {
+    const char *slot = strstr(pattern, "%s");
+    if (!slot) {
+        fprintf(stderr, "ERROR: --variants needs `%%s` in [outfile] for the variant name, e.g. colors-%%s.lua!\n");
+        return false;
+    }
+
+    int width, height;
+    unsigned char *image = thumb ? decode_preview(decoder, data, size, &width, &height)
+                                 : decoder->decode_full(data, size, &width, &height);
+    if (!image) {
+        fprintf(stderr, "ERROR: Failed to parse file `%s`: %s\n", name, decoder->failure_reason());
+        return false;
+    }
+    size_t pixels = (size_t)width * height;
+
+    bool need[2] = { false, false };
+    for (size_t i = 0; i < count; i++) need[variants[picked[i]].colorful] = true;
+
+    engine_limits_t windows[2] = { engine_limits(), engine_limits() };
+    windows[1].min_s = colorful_min_saturation;
+    windows[1].max_s = colorful_max_saturation;
+
+    accents_t accents[2] = {0};
+    histogram_t hist = {0};
+    bool ok = true;
+    if (engine->pick_windows && !use_pixels(engine, 0, options.accent_count)) {
+        /* Both windows from one read of the colors. */
+        size_t first = need[0] ? 0 : 1, end = need[1] ? 2 : 1;
+        color_stream_t colors = {0};
+        ok = image_colors(image, pixels, &hist, &colors) &&
+             engine->pick_windows(&colors, false, windows + first, end - first, accents + first);
+        color_stream_free(&colors);
+    } else {
+        /* The plain window first, the colorful one replaces it. */
+        if (need[0]) ok = image_accents(engine, image, pixels, options.accent_count, &hist, &accents[0]);
+        if (ok && need[1]) {
+            bool saved_default = engine_limits_default();
+            engine_set_limits(windows[1]);
+            ok = image_accents(engine, image, pixels, options.accent_count, &hist, &accents[1]);
+            if (saved_default) engine_reset_limits();
+            else engine_set_limits(windows[0]);
+        }
+    }
+    histogram_free(&hist);
+    decoder->free_image(image);
+    if (!ok) return false;
+
+    palette_t palettes[VARIANT_COUNT];
+    char *targets[VARIANT_COUNT] = {0};
+    bool written[VARIANT_COUNT] = {0};
+    size_t prefix = slot - pattern;
+    for (size_t i = 0; i < count; i++) {
+        const char *variant = variants[picked[i]].name;
+        size_t len = strlen(pattern) - 2 + strlen(variant) + 1;
+        targets[i] = malloc(len);
+        if (!targets[i]) {
+            fprintf(stderr, "ERROR: Out of memory!\n");
+            for (size_t j = 0; j < i; j++) free(targets[j]);
+            return false;
+        }
+        snprintf(targets[i], len, "%.*s%s%s", (int)prefix, pattern, variant, slot + 2);
+    }
+
+    variant_job_t job = { picked, accents, options, palettes, targets, written };
+    parallel_for(count, variant_generate, &job);
+
+    for (size_t i = 0; i < count; i++) {
+        print_fallback(&palettes[i]);
+        if (written[i]) {
+            printf("%s (%s):\n", variants[picked[i]].name, targets[i]);
+            print_palette(&palettes[i]);
+        }
+        ok = ok && written[i];
+        free(targets[i]);
+    }
+    return ok;
+}
+
+static void print_version(const char *name) {
+    printf("%s %d.%d.%d\n", name, VERSION_MAJOR, VERSION_MINOR, VERSION_PATCH);
+    printf("cpu: %s (detected %s)\n", cpu_level_name(cpu_level()), cpu_level_name(cpu_detected()));
+    printf("   unpack    : %s\n", cpu_level_name(cpu_pick(HISTOGRAM_UNPACK_LEVELS)));
+    printf("   histogram : %s\n", cpu_level_name(cpu_pick(HISTOGRAM_HASH_LEVELS)));
+    printf("   hsv       : %s\n", cpu_level_name(cpu_pick(COLOR_HSV_LEVELS)));
+    printf("   oklab     : %s\n", cpu_level_name(cpu_pick(COLOR_OKLAB_LEVELS)));
+    printf("   hue bins  : %s\n", cpu_level_name(cpu_pick(COLOR_HUE_BINS_LEVELS)));
+}
+
+static void print_help(const char *name) {
+    printf("%s [infile] [outfile] <flags>\n", name);
+    printf("<flags> :\n");
+    printf("   -l : generate light mode.\n");
+    printf("   -m : generate monochrome palette.\n");
+    printf("   -c : generate colorful palette (saturation window of src/config.h).\n");
+    printf("   -h : print this help.\n");
+    printf("   -v : print version and the SIMD level of each kernel.\n");
+    printf("   --max-mem <size> : cap memory use, e.g. 512M (out-of-core mode for huge images).\n");
+    printf("   --thumb : use the embedded EXIF thumbnail or a reduced decode, much faster with a thumbnail or libjpeg\n");
+    printf("             (stb, e.g. for PNG, decodes the whole image then downscales: no faster than a plain run).\n");
+    printf("   --decoder <name> : force a decoder backend (");
+    for (size_t i = 0; i < decoder_count(); i++) {
+        printf("%s%s", i ? ", " : "", decoder_get(i)->name);
+    }
+    printf(").\n");
+    printf("   --engine <name>  : pick the accents with (");
+    for (size_t i = 0; i < engine_count(); i++) {
+        printf("%s%s", i ? ", " : "", engine_get(i)->name);
+    }
+    printf("), %s by default.\n", engine_get(0)->name);
+    printf("   --variants <list> : write each of dark, light, mono, colorful (comma separated) from one\n");
+    printf("                       decode, [outfile] then needs a `%%s` for the name, e.g. colors-%%s.lua.\n");
+    printf("   --accents <n>    : list n accents (2 to %d), the ones past the second as far apart as can be.\n",
+           ACCENTS_MAX);
+    printf("   --contrast <ratio> : least WCAG contrast of the colors against color00/08, 1 to turn off (%.1f).\n",
+           min_fg_contrast);
+    printf("   --seed <n>       : seed of the engines that draw random numbers (kmeans), fixed by default.\n");
+    printf("   --lightness <min>:<max>  : accent value window, e.g. 0.45:0.8 (see src/config.h).\n");
+    printf("   --saturation <min>:<max> : accent saturation window, e.g. 0.15:0.78.\n");
+    printf("   --bench-decoders : time every decoder backend on [infile] and exit.\n");
+    printf("   --bench-colors   : time the HSV and OKLab color conversions and exit.\n");
+    printf("   --self-test      : check every SIMD kernel variant against the scalar one, and the contrast step, and exit.\n");
+    printf("   --cpu <level>    : cap the SIMD level (scalar, sse2, sse4.1, avx2, avx512).\n");
+}
+
+int main(int argc, char **argv) {
+    /* -- Opening -- */
+    bool monochrome = false;
+    bool dark_mode = true;
+    size_t max_mem = 0;
+    const char *decoder_name = NULL;
+    const engine_t *engine = engine_get(0);
+    engine_limits_t limits = engine_limits();
+    bool limits_set = false;
+    size_t accent_count = 2;
+    float min_contrast = min_fg_contrast;
+    size_t variant_list[VARIANT_COUNT];
+    size_t variant_count = 0;
+    bool bench = false;
+    bool bench_colors = false;
+    bool self_check = false;
+    bool version = false;
+    bool thumb = false;
+
+    /* Probe once before any worker thread exists. */
+    cpu_detected();
+
+    char *target = NULL;
+    char *input = NULL;
+
+    bool exit_mode = false;
+    for (int i = 1; i < argc; i++) {
+        char *current = argv[i];
+        if (current[0] == '-') {
+            if (strlen(current) < 2) continue; // need minimal `-[a]` so min 2
+            const char *value = NULL;
+            switch (current[1]) {
+            case 'h':
+                print_help(argv[0]);
+                exit_mode = true;
+                break;
+            case 'v':
+                version = true;
+                exit_mode = true;
+                break;
+            case 'l':
+                dark_mode = false;
+                break;
+            case 'm':
+                monochrome = true;
+                break;
+            case 'c':
+                limits.min_s = colorful_min_saturation;
+                limits.max_s = colorful_max_saturation;
+                limits_set = true;
+                break;
+            case '-':
+                if ((value = long_arg_value(argc, argv, &i, "--max-mem"))) {
+                    if (!parse_size(value, &max_mem) || max_mem == 0) {
+                        fprintf(stderr, "ERROR: Invalid --max-mem `%s`!\n", value);
+                        return 1;
+                    }
+                    break;
+                }
+                if ((value = long_arg_value(argc, argv, &i, "--decoder"))) {
+                    decoder_name = value;
+                    break;
+                }
+                if ((value = long_arg_value(argc, argv, &i, "--engine"))) {
+                    engine = engine_find(value);
+                    if (!engine) {
+                        fprintf(stderr, "ERROR: Unknown engine `%s`!\n", value);
+                        return 1;
+                    }
+                    break;
+                }
+                if ((value = long_arg_value(argc, argv, &i, "--accents"))) {
+                    char *end;
+                    unsigned long count = strtoul(value, &end, 10);
+                    if (end == value || *end != '\0' || count < 2 || count > ACCENTS_MAX) {
+                        fprintf(stderr, "ERROR: Invalid --accents `%s`, expected 2 to %d!\n", value, ACCENTS_MAX);
+                        return 1;
+                    }
+                    accent_count = count;
+                    break;
+                }
+                if ((value = long_arg_value(argc, argv, &i, "--contrast"))) {
+                    char *end;
+                    min_contrast = strtof(value, &end);
+                    if (end == value || *end != '\0' || !(min_contrast >= 0.0f && min_contrast <= 21.0f)) {
+                        fprintf(stderr, "ERROR: Invalid --contrast `%s`, expected a ratio up to 21!\n", value);
+                        return 1;
+                    }
+                    break;
+                }
+                if ((value = long_arg_value(argc, argv, &i, "--seed"))) {
+                    char *end;
+                    errno = 0;
+                    unsigned long long seed = strtoull(value, &end, 0);
+                    if (end == value || *end != '\0' || errno == ERANGE) {
+                        fprintf(stderr, "ERROR: Invalid --seed `%s`!\n", value);
+                        return 1;
+                    }
+                    engine_set_seed(seed);
+                    break;
+                }
+                if ((value = long_arg_value(argc, argv, &i, "--variants"))) {
+                    if (!parse_variants(value, variant_list, &variant_count)) return 1;
+                    break;
+                }
+                if ((value = long_arg_value(argc, argv, &i, "--lightness"))) {
+                    if (!parse_range(value, &limits.min_v, &limits.max_v)) {
+                        fprintf(stderr, "ERROR: Invalid --lightness `%s`, expected <min>:<max> within 0 and 1!\n", value);
+                        return 1;
+                    }
+                    limits_set = true;
+                    break;
+                }
+                if ((value = long_arg_value(argc, argv, &i, "--saturation"))) {
+                    if (!parse_range(value, &limits.min_s, &limits.max_s)) {
+                        fprintf(stderr, "ERROR: Invalid --saturation `%s`, expected <min>:<max> within 0 and 1!\n", value);
+                        return 1;
+                    }
+                    limits_set = true;
+                    break;
+                }
+                if (strcmp(current, "--thumb") == 0) {
+                    thumb = true;
+                    break;
+                }
+                if (strcmp(current, "--bench-decoders") == 0) {
+                    bench = true;
+                    break;
+                }
+                if ((value = long_arg_value(argc, argv, &i, "--cpu"))) {
+                    if (!cpu_force(value)) {
+                        fprintf(stderr, "ERROR: Unsupported --cpu `%s`, this CPU goes up to %s!\n",
+                                value, cpu_level_name(cpu_detected()));
+                        return 1;
+                    }
+                    break;
+                }
+                if (strcmp(current, "--bench-colors") == 0) {
+                    bench_colors = true;
+                    exit_mode = true;
+                    break;
+                }
+                if (strcmp(current, "--self-test") == 0) {
+                    self_check = true;
+                    exit_mode = true;
+                    break;
+                }
+                fprintf(stderr, "ERROR: Not a valid argument!\n");
+                break;
+            default:
+                fprintf(stderr, "ERROR: Not a valid argument!\n");
+                break;
+            }
+        } else {
+            if (!input) input = current;
+            else if (!target) target = current;
+            else continue;
+        }
+    }
+    if (!exit_mode && (!input || (!target && !bench))) {
+        fprintf(stderr, "ERROR: Not enought argument!\n");
+        return 1;
+    }
+
+    if (version) print_version(argv[0]);
+    if (bench_colors) color_benchmark(stdout);
+    if (self_check && !self_test(stdout)) return 1;
+    if (exit_mode) return 0;
+    if (limits_set) engine_set_limits(limits);
+
+    FILE *in_file = fopen(input, "rb");
+    if (!in_file) {
+        fprintf(stderr, "ERROR: Failed to open the file: %s\n", strerror(errno));
+        return 1;
+    }
+
+    format_e format = detect_format(in_file);
+    const decoder_t *decoder = decoder_for_format(format);
+    if (decoder_name) {
+        decoder = decoder_find(decoder_name);
+        if (!decoder) {
+            fprintf(stderr, "ERROR: Unknown decoder `%s`!\n", decoder_name);
+            return 1;
+        }
+        if (!decoder->probe(format)) {
+            fprintf(stderr, "ERROR: The %s decoder can not decode `%s`!\n", decoder->name, input);
+            return 1;
+        }
+    }
+    if (!decoder && !bench) {
+        fprintf(stderr, "ERROR: File `%s` is not a png or jpeg file!\n", input);
+        return 1;
+    }
+
+    size_t data_size = 0;
+    unsigned char *data = map_file(in_file, &data_size);
+    if (!data) {
+        fprintf(stderr, "ERROR: Failed to read the file `%s`!\n", input);
+        return 1;
+    }
+
+    /* Don't need it anymore goodbye! */
+    fclose(in_file);
+
+    if (bench) {
+        decoder_benchmark(data, data_size, stdout);
+        munmap(data, data_size);
+        return 0;
+    }
+
+    palette_options_t options = { monochrome, dark_mode, accent_count, min_contrast };
+    if (variant_count) {
+        if (max_mem) {
+            fprintf(stderr, "ERROR: --variants keeps the image in memory, it can not be used with --max-mem!\n");
+            return 1;
+        }
+        bool ok = run_variants(data, data_size, decoder, thumb, input, engine, options, target,
+                               variant_list, variant_count);
+        munmap(data, data_size);
+        return ok ? 0 : 1;
+    }
+
+    accents_t accents;
+    bool picked;
+    color_table_t tables[PARALLEL_MAX_THREADS] = {0};
+    histogram_t hist = {0};
+    color_stream_t colors;
+    /* An engine that rescans has the whole image held for its passes: a
+     * file the decoder streams is counted row by row for its pick instead. */
+    bool streamed = false;
+    bool pixels = use_pixels(engine, max_mem, accent_count);
+    if (pixels && engine->pick && engine->rescan && !thumb && decoder->decode_rows) {
+        if (!count_colors(data, data_size, decoder, max_mem, thumb, input, tables, &hist, &colors, &streamed)) {
+            return 1;
+        }
+        pixels = !streamed;
+    }
+
+    if (pixels) {
+        void *state = feed_engine(data, data_size, decoder, max_mem, thumb, input, engine);
+        munmap(data, data_size);
+        if (!state) return 1;
+
+        /* -- Work -- */
+
+        picked = engine->finish(state, monochrome, &accents);
+        engine->end(state);
+    } else {
+        if (!streamed && !count_colors(data, data_size, decoder, max_mem, thumb, input, tables, &hist, &colors,
+                                       NULL)) {
+            return 1;
+        }
+        munmap(data, data_size);
+
+        /* -- Work -- */
+
+        picked = engine->pick(&colors, monochrome, &accents);
+        if (colors.failed) {
+            fprintf(stderr, "ERROR: Failed to read back the spilled colors of `%s`!\n", input);
+            picked = false;
+        }
+
+        /* Don't need it anymore goodbye! */
+        color_stream_free(&colors);
+        free_tables(tables, parallel_thread_count());
+        histogram_free(&hist);
+    }
+    if (!picked) return 1;
+
+    palette_t palette;
+    options.monochrome = monochrome;
+    options.dark_mode = dark_mode;
+    generate_palette(&accents, options, &palette);
+    print_fallback(&palette);
+
+    /* -- Output the file -- */
+    if (!write_palette(target, &palette)) return 1;
+    print_palette(&palette);
 
     return 0;
 }
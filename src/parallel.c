@@ -0,0 +1,64 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#include "parallel.h"
+
+typedef struct {
+    parallel_fn fn;
+    void *ctx;
+    size_t count;
+    atomic_size_t next;
+} job_t;
+
+typedef struct {
+    job_t *job;
+    size_t worker;
+} worker_t;
+
+size_t parallel_thread_count(void) {
+    static size_t count = 0;
+    if (count == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        count = (online > 0) ? (size_t)online : 1;
+        if (count > PARALLEL_MAX_THREADS) count = PARALLEL_MAX_THREADS;
+    }
+    return count;
+}
+
+static void run_worker(job_t *job, size_t worker) {
+    size_t i;
+    while ((i = atomic_fetch_add(&job->next, 1)) < job->count) {
+        job->fn(job->ctx, i, worker);
+    }
+}
+
+static void *worker_main(void *arg) {
+    worker_t *w = arg;
+    run_worker(w->job, w->worker);
+    return NULL;
+}
+
+void parallel_for(size_t count, parallel_fn fn, void *ctx) {
+    job_t job = { .fn = fn, .ctx = ctx, .count = count };
+    atomic_init(&job.next, 0);
+
+    size_t threads = parallel_thread_count();
+    if (threads > count) threads = count;
+
+    pthread_t ids[PARALLEL_MAX_THREADS];
+    worker_t workers[PARALLEL_MAX_THREADS];
+    size_t spawned = 0;
+
+    /* The calling thread is worker 0, if spawning fails it just does more. */
+    for (size_t i = 1; i < threads; i++) {
+        workers[spawned] = (worker_t){ &job, spawned + 1 };
+        if (pthread_create(&ids[spawned], NULL, worker_main, &workers[spawned]) != 0) break;
+        spawned++;
+    }
+    run_worker(&job, 0);
+
+    for (size_t i = 0; i < spawned; i++) {
+        pthread_join(ids[i], NULL);
+    }
+}
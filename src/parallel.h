@@ -0,0 +1,14 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stddef.h>
+
+#define PARALLEL_MAX_THREADS 64
+
+/* `worker` is unique per running thread and below parallel_thread_count(). */
+typedef void (*parallel_fn)(void *ctx, size_t index, size_t worker);
+
+size_t parallel_thread_count(void);
+void parallel_for(size_t count, parallel_fn fn, void *ctx);
+
+#endif /* PARALLEL_H */
@@ -0,0 +1,461 @@
+#ifndef PNG_PIPE_H
+#define PNG_PIPE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Called from the counting threads with one decoded RGBA row. `worker` is
+ * below parallel_thread_count() and never shared by two running threads. */
+typedef void (*png_pipe_row_fn)(void *user, size_t worker, const unsigned char *rgba, int width, int y);
+
+/* Decode a non-interlaced 8-bit PNG as a three stage pipeline: the calling
+ * thread inflates the IDAT stream block by block into a sliding window, an
+ * unfilter thread undoes the scanline filters, and one or more counting
+ * threads expand the rows to RGBA and hand them to `fn`. The stages talk
+ * through bounded lock-free rings of scanlines, so counting finishes
+ * shortly after the last deflate block instead of after a full decode.
+ * IDAT chunks are read through a small staging buffer and the output
+ * window slides, so memory does not grow with the image size; a non-zero
+ * `mem_budget` (bytes) also trims the ring depth so the rings, the staging
+ * buffer and the window fit in it, down to two rows per ring.
+ *
+ * Returns false when the file is not eligible (interlaced, 16-bit, ...) or
+ * is corrupt; rows may already have been delivered in the latter case. */
+bool png_pipe_decode(const unsigned char *buffer, size_t len, size_t mem_budget,
+                     int *width, int *height, png_pipe_row_fn fn, void *user);
+
+#ifdef PNG_PIPE_IMPLEMENTATION
+
+#ifndef STB_IMAGE_IMPLEMENTATION
+#error "png_pipe.h needs the stb_image implementation in the same translation unit"
+#endif
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "parallel.h"
+#include "ring.h"
+
+#define PNG_PIPE_RING_ROWS 64
+#define PNG_PIPE_WINDOW    (1 << 15) /* deflate back-reference distance */
+#define PNG_PIPE_STAGE     (1 << 20)
+
+typedef struct {
+    const unsigned char *data;
+    size_t len;
+} png_pipe_span_t;
+
+/* Concatenated view over the IDAT chunks, materialized a bit at a time. */
+typedef struct {
+    const png_pipe_span_t *spans;
+    size_t span_count;
+    size_t span, span_pos;
+
+    unsigned char *buf;
+    size_t cap, len;
+} png_pipe_stage_t;
+
+typedef struct {
+    int width, height;
+    int color_type;
+    int channels;
+    size_t stride;
+    unsigned char palette[256 * 4];
+
+    ring_t filtered;                    /* inflate  -> unfilter */
+    ring_t rows[PARALLEL_MAX_THREADS];  /* unfilter -> counter, round robin */
+    size_t counters;
+
+    png_pipe_row_fn fn;
+    void *user;
+    atomic_bool failed;
+} png_pipe_t;
+
+typedef struct {
+    png_pipe_t *pipe;
+    size_t index;
+} png_pipe_counter_t;
+
+static uint32_t png_pipe_be32(const unsigned char *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void png_pipe_fail(png_pipe_t *pipe) {
+    atomic_store(&pipe->failed, true);
+    ring_close(&pipe->filtered);
+}
+
+static void png_pipe_unfilter_row(unsigned char *cur, const unsigned char *prev,
+                                  const unsigned char *raw, int filter, size_t stride, int bpp) {
+    size_t i;
+    switch (filter) {
+    case 0:
+        memcpy(cur, raw, stride);
+        break;
+    case 1:
+        for (i = 0; i < (size_t)bpp; i++) cur[i] = raw[i];
+        for (; i < stride; i++) cur[i] = raw[i] + cur[i - bpp];
+        break;
+    case 2:
+        for (i = 0; i < stride; i++) cur[i] = raw[i] + prev[i];
+        break;
+    case 3:
+        for (i = 0; i < (size_t)bpp; i++) cur[i] = raw[i] + (prev[i] >> 1);
+        for (; i < stride; i++) cur[i] = raw[i] + ((prev[i] + cur[i - bpp]) >> 1);
+        break;
+    case 4:
+        for (i = 0; i < (size_t)bpp; i++) cur[i] = raw[i] + prev[i];
+        for (; i < stride; i++) cur[i] = raw[i] + stbi__paeth(cur[i - bpp], prev[i], prev[i - bpp]);
+        break;
+    }
+}
+
+static void *png_pipe_unfilter_main(void *arg) {
+    png_pipe_t *pipe = arg;
+    unsigned char *prev = calloc(pipe->stride, 1);
+    unsigned char *cur  = malloc(pipe->stride);
+    if (!prev || !cur) png_pipe_fail(pipe);
+
+    for (size_t y = 0; prev && cur; y++) {
+        unsigned char *raw = ring_pop(&pipe->filtered);
+        if (!raw) break;
+        if (raw[0] > 4) {
+            png_pipe_fail(pipe);
+            break;
+        }
+        png_pipe_unfilter_row(cur, prev, raw + 1, raw[0], pipe->stride, pipe->channels);
+        ring_pop_commit(&pipe->filtered);
+
+        ring_t *out = &pipe->rows[y % pipe->counters];
+        unsigned char *slot = ring_push(out);
+        if (!slot) break;
+        memcpy(slot, cur, pipe->stride);
+        ring_push_commit(out);
+
+        unsigned char *tmp = prev;
+        prev = cur;
+        cur = tmp;
+    }
+
+    /* Let the inflate stage stop early if we bailed out. */
+    ring_close(&pipe->filtered);
+    for (size_t i = 0; i < pipe->counters; i++) ring_close(&pipe->rows[i]);
+    free(prev);
+    free(cur);
+    return NULL;
+}
+
+static void *png_pipe_counter_main(void *arg) {
+    png_pipe_counter_t *c = arg;
+    png_pipe_t *pipe = c->pipe;
+    ring_t *in = &pipe->rows[c->index];
+    unsigned char *rgba = malloc((size_t)pipe->width * 4);
+    if (!rgba) png_pipe_fail(pipe);
+
+    for (size_t y = c->index; rgba; y += pipe->counters) {
+        unsigned char *row = ring_pop(in);
+        if (!row) break;
+        for (int x = 0; x < pipe->width; x++) {
+            unsigned char *o = rgba + x * 4;
+            const unsigned char *p = row + x * pipe->channels;
+            switch (pipe->color_type) {
+            case 0: o[0] = o[1] = o[2] = p[0]; o[3] = 255;  break;
+            case 2: o[0] = p[0]; o[1] = p[1]; o[2] = p[2]; o[3] = 255; break;
+            case 3: memcpy(o, pipe->palette + p[0] * 4, 4); break;
+            case 4: o[0] = o[1] = o[2] = p[0]; o[3] = p[1]; break;
+            case 6: memcpy(o, p, 4); break;
+            }
+        }
+        ring_pop_commit(in);
+        if (!atomic_load(&pipe->failed)) pipe->fn(pipe->user, c->index, rgba, pipe->width, (int)y);
+    }
+
+    /* Keep draining so the unfilter stage can never block on us. */
+    while (ring_pop(in)) ring_pop_commit(in);
+    free(rgba);
+    return NULL;
+}
+
+static bool png_pipe_stage_more(const png_pipe_stage_t *stage) {
+    return stage->span < stage->span_count;
+}
+
+/* Drop what the decoder consumed and top the buffer up from the chunks. */
+static void png_pipe_stage_refill(png_pipe_stage_t *stage, stbi__zbuf *a) {
+    size_t consumed = a->zbuffer - stage->buf;
+    memmove(stage->buf, stage->buf + consumed, stage->len - consumed);
+    stage->len -= consumed;
+
+    while (stage->len < stage->cap && png_pipe_stage_more(stage)) {
+        const png_pipe_span_t *span = &stage->spans[stage->span];
+        size_t n = span->len - stage->span_pos;
+        if (n > stage->cap - stage->len) n = stage->cap - stage->len;
+        memcpy(stage->buf + stage->len, span->data + stage->span_pos, n);
+        stage->len += n;
+        stage->span_pos += n;
+        if (stage->span_pos == span->len) {
+            stage->span++;
+            stage->span_pos = 0;
+        }
+    }
+    a->zbuffer = stage->buf;
+    a->zbuffer_end = stage->buf + stage->len;
+}
+
+static int png_pipe_inflate_block(stbi__zbuf *a, int *final) {
+    *final = stbi__zreceive(a, 1);
+    int type = stbi__zreceive(a, 2);
+    if (type == 0) return stbi__parse_uncompressed_block(a);
+    if (type == 3) return 0;
+    if (type == 1) {
+        if (!stbi__zbuild_huffman(&a->z_length, stbi__zdefault_length, STBI__ZNSYMS)) return 0;
+        if (!stbi__zbuild_huffman(&a->z_distance, stbi__zdefault_distance, 32)) return 0;
+    } else {
+        if (!stbi__compute_huffman_codes(a)) return 0;
+    }
+    return stbi__parse_huffman_block(a);
+}
+
+/* stbi__parse_zlib(), but hands complete scanlines to the unfilter stage
+ * after every deflate block and slides the output window so only the last
+ * 32K of history is kept. */
+static bool png_pipe_inflate(png_pipe_t *pipe, const png_pipe_span_t *spans, size_t span_count) {
+    size_t row_bytes = pipe->stride + 1;
+    size_t cap = 4 * (PNG_PIPE_WINDOW + row_bytes);
+
+    png_pipe_stage_t stage = { .spans = spans, .span_count = span_count, .cap = PNG_PIPE_STAGE };
+    stage.buf = malloc(stage.cap);
+
+    stbi__zbuf a;
+    a.zout_start = malloc(cap);
+    a.zout = a.zout_start;
+    a.zout_end = a.zout_start + cap;
+    a.z_expandable = 1;
+
+    bool ok = stage.buf && a.zout_start;
+    if (ok) {
+        a.zbuffer = stage.buf;
+        png_pipe_stage_refill(&stage, &a);
+        ok = stbi__parse_zlib_header(&a);
+    }
+    a.num_bits = 0;
+    a.code_buffer = 0;
+    a.hit_zeof_once = 0;
+
+    size_t emitted = 0;
+    int rows_out = 0;
+    int final = 0;
+    while (ok && !final) {
+        if ((size_t)(a.zbuffer_end - a.zbuffer) < stage.cap / 2) png_pipe_stage_refill(&stage, &a);
+
+        /* A block that ran off the end of the staged input saw fake zero
+         * bits: rewind, stage more input and decode it again. */
+        stbi__zbuf saved = a;
+        size_t saved_in = a.zbuffer - stage.buf;
+        size_t saved_out = a.zout - a.zout_start;
+        for (;;) {
+            ok = png_pipe_inflate_block(&a, &final);
+            bool starved = !ok || a.hit_zeof_once || a.zbuffer >= a.zbuffer_end;
+            if (!starved || !png_pipe_stage_more(&stage)) break;
+
+            if (saved_in > 0) {
+                a.zbuffer = stage.buf + saved_in;
+                png_pipe_stage_refill(&stage, &a);
+                saved_in = 0;
+            } else {
+                unsigned char *grown = realloc(stage.buf, stage.cap * 2);
+                if (!grown) break;
+                stage.buf = grown;
+                stage.cap *= 2;
+                a.zbuffer = stage.buf;
+                png_pipe_stage_refill(&stage, &a);
+            }
+            char *out_start = a.zout_start, *out_end = a.zout_end;
+            stbi_uc *in = a.zbuffer, *in_end = a.zbuffer_end;
+            a = saved;
+            a.zout_start = out_start;
+            a.zout_end = out_end;
+            a.zout = out_start + saved_out;
+            a.zbuffer = in;
+            a.zbuffer_end = in_end;
+        }
+
+        size_t used = a.zout - a.zout_start;
+        while (ok && rows_out < pipe->height && used - emitted >= row_bytes) {
+            unsigned char *slot = ring_push(&pipe->filtered);
+            if (!slot) {
+                ok = false;
+                break;
+            }
+            memcpy(slot, a.zout_start + emitted, row_bytes);
+            ring_push_commit(&pipe->filtered);
+            emitted += row_bytes;
+            rows_out++;
+        }
+
+        /* Blocks that overflowed the window were grown by stbi__zexpand(),
+         * so the history is always intact here; just drop what is no
+         * longer reachable. */
+        size_t keep_from = (used > PNG_PIPE_WINDOW) ? used - PNG_PIPE_WINDOW : 0;
+        if (keep_from > emitted) keep_from = emitted;
+        if (keep_from > (size_t)(a.zout_end - a.zout_start) / 2) {
+            memmove(a.zout_start, a.zout_start + keep_from, used - keep_from);
+            a.zout -= keep_from;
+            emitted -= keep_from;
+        }
+    }
+
+    free(stage.buf);
+    free(a.zout_start);
+    return ok && rows_out == pipe->height;
+}
+
+bool png_pipe_decode(const unsigned char *buffer, size_t len, size_t mem_budget,
+                     int *width, int *height, png_pipe_row_fn fn, void *user) {
+    static const unsigned char signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+    if (len < 8 + 25 || memcmp(buffer, signature, 8) != 0) return false;
+
+    const unsigned char *p = buffer + 8;
+    const unsigned char *end = buffer + len;
+
+    png_pipe_t *pipe = calloc(1, sizeof(png_pipe_t));
+    if (!pipe) return false;
+    pipe->fn = fn;
+    pipe->user = user;
+    atomic_init(&pipe->failed, false);
+
+    /* Walk the chunks, validating IHDR and gathering the IDAT payloads. */
+    png_pipe_span_t *idat = NULL;
+    size_t idat_count = 0, idat_cap = 0;
+    bool seen_ihdr = false, seen_iend = false, ok = true;
+    while (ok && !seen_iend && end - p >= 12) {
+        uint32_t clen = png_pipe_be32(p);
+        uint32_t type = png_pipe_be32(p + 4);
+        const unsigned char *data = p + 8;
+        if ((size_t)(end - data) < (size_t)clen + 4) {
+            ok = false;
+            break;
+        }
+        if (!seen_ihdr && type != STBI__PNG_TYPE('I','H','D','R')) {
+            ok = false;
+            break;
+        }
+
+        switch (type) {
+        case STBI__PNG_TYPE('I','H','D','R'):
+            ok = clen == 13;
+            if (!ok) break;
+            pipe->width  = (int)png_pipe_be32(data);
+            pipe->height = (int)png_pipe_be32(data + 4);
+            pipe->color_type = data[9];
+            ok = data[8] == 8 && data[12] == 0 &&
+                 pipe->width > 0 && pipe->height > 0 &&
+                 pipe->width <= STBI_MAX_DIMENSIONS && pipe->height <= STBI_MAX_DIMENSIONS;
+            switch (pipe->color_type) {
+            case 0: pipe->channels = 1; break;
+            case 2: pipe->channels = 3; break;
+            case 3: pipe->channels = 1; break;
+            case 4: pipe->channels = 2; break;
+            case 6: pipe->channels = 4; break;
+            default: ok = false; break;
+            }
+            pipe->stride = (size_t)pipe->width * pipe->channels;
+            seen_ihdr = true;
+            break;
+        case STBI__PNG_TYPE('C','g','B','I'):
+            ok = false; /* Apple's BGR variant, leave it to stb */
+            break;
+        case STBI__PNG_TYPE('P','L','T','E'):
+            for (uint32_t i = 0; i < clen / 3 && i < 256; i++) {
+                pipe->palette[i * 4 + 0] = data[i * 3 + 0];
+                pipe->palette[i * 4 + 1] = data[i * 3 + 1];
+                pipe->palette[i * 4 + 2] = data[i * 3 + 2];
+                pipe->palette[i * 4 + 3] = 255;
+            }
+            break;
+        case STBI__PNG_TYPE('t','R','N','S'):
+            if (pipe->color_type == 3) {
+                for (uint32_t i = 0; i < clen && i < 256; i++) pipe->palette[i * 4 + 3] = data[i];
+            }
+            break;
+        case STBI__PNG_TYPE('I','D','A','T'):
+            if (clen == 0) break;
+            if (idat_count == idat_cap) {
+                idat_cap = idat_cap ? idat_cap * 2 : 64;
+                png_pipe_span_t *grown = realloc(idat, idat_cap * sizeof(png_pipe_span_t));
+                if (!grown) {
+                    ok = false;
+                    break;
+                }
+                idat = grown;
+            }
+            idat[idat_count++] = (png_pipe_span_t){ data, clen };
+            break;
+        case STBI__PNG_TYPE('I','E','N','D'):
+            seen_iend = true;
+            break;
+        }
+        p = data + clen + 4;
+    }
+    ok = ok && seen_ihdr && idat_count > 0;
+
+    pthread_t unfilter, counters[PARALLEL_MAX_THREADS];
+    png_pipe_counter_t counter_args[PARALLEL_MAX_THREADS];
+    size_t started = 0;
+    bool unfilter_started = false;
+
+    if (ok) {
+        size_t threads = parallel_thread_count();
+        pipe->counters = (threads > 2) ? threads - 2 : 1;
+
+        size_t depth = PNG_PIPE_RING_ROWS;
+        if (mem_budget) {
+            /* The staging buffer and the inflate window come out of it first. */
+            size_t fixed = PNG_PIPE_STAGE + 4 * (PNG_PIPE_WINDOW + pipe->stride + 1);
+            size_t rings = mem_budget > fixed ? mem_budget - fixed : 0;
+            size_t fit = rings / ((pipe->stride + 1) * (pipe->counters + 1));
+            if (fit < depth) depth = (fit > 2) ? fit : 2;
+        }
+        ok = ring_init(&pipe->filtered, pipe->stride + 1, depth);
+        for (size_t i = 0; ok && i < pipe->counters; i++) {
+            ok = ring_init(&pipe->rows[i], pipe->stride, depth);
+        }
+    }
+
+    if (ok) {
+        for (size_t i = 0; i < pipe->counters; i++) {
+            counter_args[i] = (png_pipe_counter_t){ pipe, i };
+            if (pthread_create(&counters[i], NULL, png_pipe_counter_main, &counter_args[i]) != 0) break;
+            started++;
+        }
+        unfilter_started = started == pipe->counters &&
+                           pthread_create(&unfilter, NULL, png_pipe_unfilter_main, pipe) == 0;
+        ok = unfilter_started;
+    }
+
+    if (ok && !png_pipe_inflate(pipe, idat, idat_count)) png_pipe_fail(pipe);
+    ring_close(&pipe->filtered);
+
+    if (unfilter_started) {
+        pthread_join(unfilter, NULL);
+    } else {
+        for (size_t i = 0; i < pipe->counters; i++) ring_close(&pipe->rows[i]);
+    }
+    for (size_t i = 0; i < started; i++) pthread_join(counters[i], NULL);
+
+    ok = ok && !atomic_load(&pipe->failed);
+    if (ok) {
+        *width = pipe->width;
+        *height = pipe->height;
+    }
+
+    ring_free(&pipe->filtered);
+    for (size_t i = 0; i < pipe->counters; i++) ring_free(&pipe->rows[i]);
+    free(idat);
+    free(pipe);
+    return ok;
+}
+
+#endif /* PNG_PIPE_IMPLEMENTATION */
+#endif /* PNG_PIPE_H */
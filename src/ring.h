@@ -0,0 +1,74 @@
+#ifndef RING_H
+#define RING_H
+
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+/* Bounded single-producer/single-consumer ring of fixed-size slots.
+ * push/pop hand out a slot pointer that stays owned by the caller until
+ * the matching *_commit; both return NULL once the ring is closed (a
+ * consumer still drains whatever was committed before the close). */
+typedef struct {
+    unsigned char *slots;
+    size_t slot_size;
+    size_t capacity; /* power of two */
+    atomic_size_t head;
+    atomic_size_t tail;
+    atomic_bool closed;
+} ring_t;
+
+static inline bool ring_init(ring_t *r, size_t slot_size, size_t capacity) {
+    size_t cap = 1;
+    while (cap < capacity) cap <<= 1;
+    r->slots = malloc(slot_size * cap);
+    r->slot_size = slot_size;
+    r->capacity = cap;
+    atomic_init(&r->head, 0);
+    atomic_init(&r->tail, 0);
+    atomic_init(&r->closed, false);
+    return r->slots != NULL;
+}
+
+static inline void ring_free(ring_t *r) {
+    free(r->slots);
+    r->slots = NULL;
+}
+
+static inline void ring_close(ring_t *r) {
+    atomic_store_explicit(&r->closed, true, memory_order_release);
+}
+
+static inline unsigned char *ring_push(ring_t *r) {
+    size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    while (head - atomic_load_explicit(&r->tail, memory_order_acquire) >= r->capacity) {
+        if (atomic_load_explicit(&r->closed, memory_order_acquire)) return NULL;
+        sched_yield();
+    }
+    if (atomic_load_explicit(&r->closed, memory_order_acquire)) return NULL;
+    return r->slots + (head & (r->capacity - 1)) * r->slot_size;
+}
+
+static inline void ring_push_commit(ring_t *r) {
+    atomic_fetch_add_explicit(&r->head, 1, memory_order_release);
+}
+
+static inline unsigned char *ring_pop(ring_t *r) {
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    while (atomic_load_explicit(&r->head, memory_order_acquire) == tail) {
+        if (atomic_load_explicit(&r->closed, memory_order_acquire)) {
+            /* Re-check, the producer may have committed right before closing. */
+            if (atomic_load_explicit(&r->head, memory_order_acquire) != tail) break;
+            return NULL;
+        }
+        sched_yield();
+    }
+    return r->slots + (tail & (r->capacity - 1)) * r->slot_size;
+}
+
+static inline void ring_pop_commit(ring_t *r) {
+    atomic_fetch_add_explicit(&r->tail, 1, memory_order_release);
+}
+
+#endif /* RING_H */
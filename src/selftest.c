@@ -0,0 +1,302 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "selftest.h"
+#include "config.h"
+#include "contrast.h"
+#include "cpu.h"
+#include "helper.h"
+#include "histogram.h"
+
+#define CHUNK     (1u << 20)
+#define CUBE      (1u << 24)
+#define MAX_WORDS 3
+
+typedef struct {
+    uint64_t rng;
+    rgb_t *rgb;
+    uint8_t *rgba;
+    float *h, *s, *v;
+    uint8_t *bytes;
+    uint32_t *want[MAX_WORDS];
+    uint32_t *got[MAX_WORDS];
+} selftest_buf_t;
+
+/* A kernel under test: `fill` prepares chunk `chunk` of the input, `run`
+ * calls the dispatcher and leaves `words` output words per lane. */
+typedef struct {
+    const char *name;
+    unsigned levels;
+    size_t chunks;
+    size_t words;
+    bool floats;
+    void (*fill)(selftest_buf_t *buf, size_t chunk);
+    void (*run)(selftest_buf_t *buf, uint32_t **out);
+    void (*describe)(const selftest_buf_t *buf, size_t i, FILE *out);
+} kernel_t;
+
+typedef struct {
+    uint64_t inputs;
+    uint64_t mismatches;
+    uint32_t max_ulp;
+} check_t;
+
+static uint32_t next_random(selftest_buf_t *buf) {
+    /* xorshift64*, fixed seed so a failure reproduces. */
+    buf->rng ^= buf->rng >> 12;
+    buf->rng ^= buf->rng << 25;
+    buf->rng ^= buf->rng >> 27;
+    return (uint32_t)((buf->rng * 0x2545F4914F6CDD1Dull) >> 32);
+}
+
+static float random_unit(selftest_buf_t *buf) {
+    return (next_random(buf) >> 8) * (1.0f / (1u << 24));
+}
+
+/* Distance between two floats in units in the last place. */
+static uint32_t ulp_distance(uint32_t a, uint32_t b) {
+    int64_t x = (int32_t)a, y = (int32_t)b;
+    if (x < 0) x = (int64_t)INT32_MIN - x;
+    if (y < 0) y = (int64_t)INT32_MIN - y;
+    int64_t d = x > y ? x - y : y - x;
+    return d > UINT32_MAX ? UINT32_MAX : (uint32_t)d;
+}
+
+/* -- Inputs -- */
+
+static void fill_cube(selftest_buf_t *buf, size_t chunk) {
+    for (uint32_t i = 0; i < CHUNK; i++) buf->rgb[i] = chunk * CHUNK + i;
+}
+
+static void fill_rgba(selftest_buf_t *buf, size_t chunk) {
+    (void)chunk;
+    for (uint32_t i = 0; i < CHUNK; i++) {
+        uint32_t x = next_random(buf);
+        memcpy(buf->rgba + i * 4, &x, 4);
+    }
+}
+
+/* The hsv of the whole cube first, so the round trip is covered, then
+ * random triples with hues outside [0, 1) for the wrap path. */
+static void fill_hsv(selftest_buf_t *buf, size_t chunk) {
+    if (chunk < CUBE / CHUNK) {
+        fill_cube(buf, chunk);
+        rgb_to_hsv_n(buf->rgb, buf->h, buf->s, buf->v, CHUNK);
+        return;
+    }
+    for (uint32_t i = 0; i < CHUNK; i++) {
+        buf->h[i] = random_unit(buf) * 6.0f - 3.0f;
+        buf->s[i] = random_unit(buf);
+        buf->v[i] = random_unit(buf);
+    }
+}
+
+/* Cube hues, then random hues in [0, 1) with random shade. */
+static void fill_hue(selftest_buf_t *buf, size_t chunk) {
+    if (chunk < CUBE / CHUNK) {
+        fill_hsv(buf, chunk);
+        return;
+    }
+    for (uint32_t i = 0; i < CHUNK; i++) {
+        buf->h[i] = random_unit(buf);
+        buf->s[i] = random_unit(buf) * 0.2f;
+        buf->v[i] = random_unit(buf) * 0.2f;
+    }
+}
+
+/* -- Kernels -- */
+
+static void run_unpack(selftest_buf_t *buf, uint32_t **out) {
+    /* An odd length so every variant also runs its tail. */
+    unpack_rgba(buf->rgba, out[0], CHUNK - 3);
+    out[0][CHUNK - 3] = out[0][CHUNK - 2] = out[0][CHUNK - 1] = 0;
+}
+
+static void run_hash(selftest_buf_t *buf, uint32_t **out) {
+    hash_rgb(buf->rgb, out[0], CHUNK);
+}
+
+static void run_rgb_to_hsv(selftest_buf_t *buf, uint32_t **out) {
+    rgb_to_hsv_n(buf->rgb, (float *)out[0], (float *)out[1], (float *)out[2], CHUNK);
+}
+
+static void run_hsv_to_rgb(selftest_buf_t *buf, uint32_t **out) {
+    hsv_to_rgb_n(buf->h, buf->s, buf->v, out[0], CHUNK);
+}
+
+static void run_oklab(selftest_buf_t *buf, uint32_t **out) {
+    rgb_to_oklab_n(buf->rgb, (float *)out[0], (float *)out[1], (float *)out[2], CHUNK);
+}
+
+static void run_hue_bins(selftest_buf_t *buf, uint32_t **out) {
+    tell_color_n(buf->h, buf->s, buf->v, buf->bytes, CHUNK);
+    for (uint32_t i = 0; i < CHUNK; i++) out[0][i] = buf->bytes[i];
+}
+
+static void describe_rgba(const selftest_buf_t *buf, size_t i, FILE *out) {
+    const uint8_t *p = buf->rgba + i * 4;
+    fprintf(out, "rgba %02x%02x%02x%02x", p[0], p[1], p[2], p[3]);
+}
+
+static void describe_rgb(const selftest_buf_t *buf, size_t i, FILE *out) {
+    fprintf(out, "rgb #%06x", buf->rgb[i]);
+}
+
+static void describe_hsv(const selftest_buf_t *buf, size_t i, FILE *out) {
+    fprintf(out, "hsv %.9g %.9g %.9g", buf->h[i], buf->s[i], buf->v[i]);
+}
+
+static const kernel_t kernels[] = {
+    { "unpack",     HISTOGRAM_UNPACK_LEVELS, 16, 1, false, fill_rgba, run_unpack,     describe_rgba },
+    { "hash",       HISTOGRAM_HASH_LEVELS,   16, 1, false, fill_cube, run_hash,       describe_rgb  },
+    { "rgb_to_hsv", COLOR_HSV_LEVELS,        16, 3, true,  fill_cube, run_rgb_to_hsv, describe_rgb  },
+    { "hsv_to_rgb", COLOR_HSV_LEVELS,        20, 1, false, fill_hsv,  run_hsv_to_rgb, describe_hsv  },
+    { "oklab",      COLOR_OKLAB_LEVELS,      16, 3, true,  fill_cube, run_oklab,      describe_rgb  },
+    { "hue_bins",   COLOR_HUE_BINS_LEVELS,   20, 1, false, fill_hue,  run_hue_bins,   describe_hsv  },
+};
+
+/* Compares one chunk and prints the first mismatch this variant has. */
+static void compare(const kernel_t *kernel, cpu_level_e level, check_t *check,
+                    const selftest_buf_t *buf, FILE *out) {
+    for (uint32_t i = 0; i < CHUNK; i++) {
+        bool same = true;
+        for (size_t w = 0; w < kernel->words; w++) {
+            uint32_t want = buf->want[w][i], got = buf->got[w][i];
+            if (want == got) continue;
+            same = false;
+            if (kernel->floats) {
+                uint32_t ulp = ulp_distance(want, got);
+                if (ulp > check->max_ulp) check->max_ulp = ulp;
+            }
+            if (check->mismatches == 0) {
+                fprintf(out, "%s/%s: first mismatch at ", kernel->name, cpu_level_name(level));
+                kernel->describe(buf, i, out);
+                fprintf(out, ", output %zu: want %08x got %08x\n", w, want, got);
+            }
+        }
+        if (!same) check->mismatches++;
+    }
+    check->inputs += CHUNK;
+}
+
+static bool test_kernel(const kernel_t *kernel, selftest_buf_t *buf, cpu_level_e top, FILE *out) {
+    check_t checks[CPU_LEVEL_COUNT] = {0};
+    for (size_t chunk = 0; chunk < kernel->chunks; chunk++) {
+        kernel->fill(buf, chunk);
+        cpu_force(cpu_level_name(CPU_SCALAR));
+        kernel->run(buf, buf->want);
+        for (int level = CPU_SCALAR + 1; level <= (int)top; level++) {
+            if (!(kernel->levels & CPU_BIT(level))) continue;
+            cpu_force(cpu_level_name((cpu_level_e)level));
+            kernel->run(buf, buf->got);
+            compare(kernel, (cpu_level_e)level, &checks[level], buf, out);
+        }
+    }
+
+    bool ok = true;
+    bool any = false;
+    for (int level = CPU_SCALAR + 1; level <= (int)top; level++) {
+        if (!(kernel->levels & CPU_BIT(level))) continue;
+        const check_t *check = &checks[level];
+        fprintf(out, "%-10s %-7s %10llu %10llu %8u\n", kernel->name, cpu_level_name((cpu_level_e)level),
+                (unsigned long long)check->inputs, (unsigned long long)check->mismatches, check->max_ulp);
+        if (check->mismatches) ok = false;
+        any = true;
+    }
+    if (!any) fprintf(out, "%-10s %-7s %10s\n", kernel->name, "-", "scalar only");
+    return ok;
+}
+
+/* The contrast solver over the backgrounds generate_palette() makes, dark
+ * and light, mid-tone ones of saturated accents included: no foreground
+ * may turn black or white or change hue, and each one passes or is as
+ * light as its hue goes. */
+#define CONTRAST_HUE_DRIFT 0.02f
+
+static bool contrast_kept(rgb_t from, rgb_t to, const rgb_t *backgrounds, float min_ratio) {
+    if (to == 0 || to == 0xFFFFFF) return from == to;
+    hsv_t a = rgb_to_hsv(from), b = rgb_to_hsv(to);
+    float drift = a.h > b.h ? a.h - b.h : b.h - a.h;
+    if (drift > 0.5f) drift = 1.0f - drift;
+    if (a.s > 0 && drift > CONTRAST_HUE_DRIFT) return false;
+    bool pass = contrast_ratio(to, backgrounds[0]) >= min_ratio * 0.999f &&
+                contrast_ratio(to, backgrounds[1]) >= min_ratio * 0.999f;
+    return pass || b.v == 1.0f;
+}
+
+static bool test_contrast(FILE *out) {
+    uint64_t inputs = 0, failures = 0;
+    for (int dark = 0; dark < 2; dark++) {
+        for (int hue = 0; hue < 360; hue += 3) {
+            for (int sat = 1; sat <= 4; sat++) {
+                float h = hue / 360.0f, s = sat / 4.0f;
+                float v = bg_color_value, alt = bg_color_value + bg_color_value_alt_diff;
+                rgb_t backgrounds[2] = {
+                    hsv_to_rgb((hsv_t){ h, s, dark ? v : 1.0f - v }),
+                    hsv_to_rgb((hsv_t){ h, s, dark ? alt : 1.0f - alt }),
+                };
+                contrast_backgrounds(backgrounds, 2, dark, min_fg_contrast);
+
+                rgb_t from[96], to[96];
+                size_t count = 0;
+                for (int fh = 0; fh < 12; fh++) {
+                    for (int fs = 1; fs <= 2; fs++) {
+                        for (int fv = 1; fv <= 4; fv++) {
+                            from[count++] = hsv_to_rgb((hsv_t){ fh / 12.0f, fs / 2.0f, fv / 4.0f });
+                        }
+                    }
+                }
+                memcpy(to, from, sizeof(from));
+                contrast_solve(to, count, backgrounds, 2, min_fg_contrast);
+
+                for (size_t i = 0; i < count; i++) {
+                    inputs++;
+                    if (contrast_kept(from[i], to[i], backgrounds, min_fg_contrast)) continue;
+                    if (failures++ == 0) {
+                        fprintf(out, "contrast: first failure at rgb #%06x on #%06x / #%06x: got #%06x\n",
+                                from[i], backgrounds[0], backgrounds[1], to[i]);
+                    }
+                }
+            }
+        }
+    }
+    fprintf(out, "%-10s %-7s %10llu %10llu\n", "contrast", "-", (unsigned long long)inputs,
+            (unsigned long long)failures);
+    return failures == 0;
+}
+
+bool self_test(FILE *out) {
+    selftest_buf_t buf = { .rng = 0x9E3779B97F4A7C15ull };
+    buf.rgb = malloc(CHUNK * sizeof(rgb_t));
+    buf.rgba = malloc(CHUNK * 4);
+    buf.h = malloc(CHUNK * sizeof(float));
+    buf.s = malloc(CHUNK * sizeof(float));
+    buf.v = malloc(CHUNK * sizeof(float));
+    buf.bytes = malloc(CHUNK);
+    bool ok = buf.rgb && buf.rgba && buf.h && buf.s && buf.v && buf.bytes;
+    for (size_t w = 0; w < MAX_WORDS; w++) {
+        buf.want[w] = malloc(CHUNK * sizeof(uint32_t));
+        buf.got[w] = malloc(CHUNK * sizeof(uint32_t));
+        ok = ok && buf.want[w] && buf.got[w];
+    }
+
+    if (!ok) {
+        fprintf(stderr, "ERROR: Out of memory!\n");
+    } else {
+        cpu_level_e top = cpu_level();
+        fprintf(out, "variants up to %s against scalar\n", cpu_level_name(top));
+        fprintf(out, "%-10s %-7s %10s %10s %8s\n", "kernel", "level", "inputs", "mismatches", "max ulp");
+        for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+            if (!test_kernel(&kernels[k], &buf, top, out)) ok = false;
+        }
+        cpu_force(cpu_level_name(top));
+        if (!test_contrast(out)) ok = false;
+    }
+
+    free(buf.rgb); free(buf.rgba); free(buf.h); free(buf.s); free(buf.v); free(buf.bytes);
+    for (size_t w = 0; w < MAX_WORDS; w++) {
+        free(buf.want[w]);
+        free(buf.got[w]);
+    }
+    return ok;
+}
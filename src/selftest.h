@@ -0,0 +1,15 @@
+#ifndef SELFTEST_H
+#define SELFTEST_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+/* Runs every SIMD variant of the hot kernels allowed by cpu_level()
+ * against the scalar one: exhaustively over the 24-bit RGB cube where the
+ * input is a color, on fixed-seed random input elsewhere. The variants
+ * are meant to be bit-identical, so any difference is a bug. Then checks
+ * the contrast step on generated palettes. Prints a table and the first
+ * mismatch of each, false if there was one. */
+bool self_test(FILE *out);
+
+#endif /* SELFTEST_H */
@@ -0,0 +1,178 @@
+/* Runs tmg-wall on a 4096x4096 picture holding every 24 bit color once,
+ * under a small --max-mem, and checks the peak memory of the run stays
+ * within the cap plus the mapped input file and some slack for the
+ * program itself.
+ * Usage: check_max_mem <tmg-wall> */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define SIDE      4096
+#define ROW_BYTES (1 + SIDE * 3)
+#define MAX_MEM   "8M"
+#define MAX_BYTES (8u << 20)
+/* The binary, its color table, libc and the thread stacks. */
+#define SLACK     (16u << 20)
+
+/* Stored deflate blocks, one per IDAT chunk. */
+#define BLOCK 65535
+
+static const char *engines[] = { "frequency", "hsv", "kmeans" };
+
+static uint32_t crc_table[256];
+
+static void crc_init(void) {
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t c = n;
+        for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        crc_table[n] = c;
+    }
+}
+
+static uint32_t crc_update(uint32_t crc, const uint8_t *data, size_t size) {
+    for (size_t i = 0; i < size; i++) crc = crc_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+static void put32(uint8_t *out, uint32_t value) {
+    out[0] = value >> 24;
+    out[1] = value >> 16;
+    out[2] = value >> 8;
+    out[3] = value;
+}
+
+static bool write_chunk(FILE *file, const char *type, const uint8_t *data, uint32_t size) {
+    uint8_t header[8];
+    put32(header, size);
+    memcpy(header + 4, type, 4);
+    uint8_t footer[4];
+    put32(footer, crc_update(crc_update(0xFFFFFFFFu, header + 4, 4), data, size) ^ 0xFFFFFFFFu);
+    return fwrite(header, 1, 8, file) == 8 && fwrite(data, 1, size, file) == size &&
+           fwrite(footer, 1, 4, file) == 4;
+}
+
+/* Byte `i` of the filtered image data: each row a 0 filter byte, then
+ * the colors y * SIDE + x in order. */
+static uint8_t raw_byte(uint64_t i) {
+    uint32_t y = i / ROW_BYTES, offset = i % ROW_BYTES;
+    if (offset == 0) return 0;
+    uint32_t rgb = y * SIDE + (offset - 1) / 3;
+    return rgb >> (16 - 8 * ((offset - 1) % 3));
+}
+
+static bool write_png(const char *path) {
+    FILE *file = fopen(path, "wb");
+    if (!file) return false;
+
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    uint8_t ihdr[13] = {0};
+    put32(ihdr, SIDE);
+    put32(ihdr + 4, SIDE);
+    ihdr[8] = 8; /* bit depth */
+    ihdr[9] = 2; /* rgb */
+    bool ok = fwrite(signature, 1, 8, file) == 8 && write_chunk(file, "IHDR", ihdr, sizeof(ihdr));
+
+    static uint8_t chunk[2 + 5 + BLOCK + 4];
+    uint64_t total = (uint64_t)SIDE * ROW_BYTES;
+    uint32_t a = 1, b = 0;
+    for (uint64_t done = 0; ok && done < total;) {
+        size_t size = 0;
+        if (done == 0) {
+            chunk[size++] = 0x78; /* zlib, 32 KB window */
+            chunk[size++] = 0x01;
+        }
+        uint32_t len = total - done < BLOCK ? total - done : BLOCK;
+        bool last = done + len == total;
+        chunk[size++] = last;
+        chunk[size++] = len & 0xFF;
+        chunk[size++] = len >> 8;
+        chunk[size++] = ~len & 0xFF;
+        chunk[size++] = (~len >> 8) & 0xFF;
+        for (uint32_t i = 0; i < len; i++) {
+            uint8_t byte = raw_byte(done + i);
+            chunk[size++] = byte;
+            a = (a + byte) % 65521;
+            b = (b + a) % 65521;
+        }
+        done += len;
+        if (last) {
+            put32(chunk + size, (b << 16) | a);
+            size += 4;
+        }
+        ok = write_chunk(file, "IDAT", chunk, size);
+    }
+
+    ok = ok && write_chunk(file, "IEND", NULL, 0);
+    return fclose(file) == 0 && ok;
+}
+
+/* Peak resident set of one run in bytes, 0 when it failed. */
+static uint64_t run_peak(const char *program, const char *input, const char *output, const char *engine) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) return 0;
+    if (pid == 0) {
+        if (!freopen("/dev/null", "w", stdout)) _exit(127);
+        execl(program, program, input, output, "--max-mem", MAX_MEM, "--engine", engine, (char *)NULL);
+        _exit(127);
+    }
+
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) != pid) return 0;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) return 0;
+    return (uint64_t)usage.ru_maxrss * 1024;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "%s [tmg-wall]\n", argv[0]);
+        return 1;
+    }
+
+    char dir[] = "/tmp/check_max_mem.XXXXXX";
+    if (!mkdtemp(dir)) {
+        fprintf(stderr, "ERROR: Failed to create a temporary directory!\n");
+        return 1;
+    }
+    char input[sizeof(dir) + 16], output[sizeof(dir) + 16];
+    snprintf(input, sizeof(input), "%s/colors.png", dir);
+    snprintf(output, sizeof(output), "%s/colors.lua", dir);
+
+    crc_init();
+    struct stat st;
+    if (!write_png(input) || stat(input, &st) != 0) {
+        fprintf(stderr, "ERROR: Failed to write `%s`!\n", input);
+        remove(input);
+        rmdir(dir);
+        return 1;
+    }
+
+    uint64_t limit = MAX_BYTES + (uint64_t)st.st_size + SLACK;
+    int failures = 0;
+    for (size_t i = 0; i < sizeof(engines) / sizeof(engines[0]); i++) {
+        uint64_t peak = run_peak(argv[1], input, output, engines[i]);
+        if (peak == 0) {
+            fprintf(stderr, "FAIL: %s: the run failed\n", engines[i]);
+            failures++;
+        } else if (peak > limit) {
+            fprintf(stderr, "FAIL: %s: peak %llu KB, limit %llu KB\n", engines[i],
+                    (unsigned long long)(peak >> 10), (unsigned long long)(limit >> 10));
+            failures++;
+        } else {
+            printf("ok: %s: peak %llu KB, limit %llu KB\n", engines[i],
+                   (unsigned long long)(peak >> 10), (unsigned long long)(limit >> 10));
+        }
+    }
+
+    remove(output);
+    remove(input);
+    rmdir(dir);
+    return failures ? 1 : 0;
+}
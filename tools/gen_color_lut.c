@@ -0,0 +1,67 @@
+/* Writes src/color_lut_table.h, see src/color_lut.h.
+ * Usage: gen_color_lut <output> */
+#define CPU_IMPLEMENTATION
+
+#include <stdio.h>
+
+#include "../src/helper.h"
+#include "../src/config.h"
+#include "../src/color_lut.h"
+
+#define CELL_COLORS 512
+
+/* The threshold bits of the 8x8x8 colors of one cell, in a batch. */
+static void classify_cell(rgb_t base, uint16_t *entries) {
+    rgb_t rgb[CELL_COLORS];
+    float h[CELL_COLORS], s[CELL_COLORS], v[CELL_COLORS];
+    for (uint32_t i = 0; i < CELL_COLORS; i++) {
+        rgb[i] = base + (((i >> 6) & 7) << 16) + (((i >> 3) & 7) << 8) + (i & 7);
+    }
+    rgb_to_hsv_n(rgb, h, s, v, CELL_COLORS);
+
+    for (uint32_t i = 0; i < CELL_COLORS; i++) {
+        uint16_t entry = 0;
+        if (v[i] >= min_lightness)  entry |= LUT_V_MIN;
+        if (v[i] <= max_lightness)  entry |= LUT_V_MAX;
+        if (s[i] >= min_saturation) entry |= LUT_S_MIN;
+        if (s[i] <= max_saturation) entry |= LUT_S_MAX;
+        entries[i] = entry;
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "%s [output]\n", argv[0]);
+        return 1;
+    }
+
+    FILE *out = fopen(argv[1], "w");
+    if (!out) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    fprintf(out, "/* Generated by tools/gen_color_lut.c from src/config.h, do not edit. */\n");
+    fprintf(out, "const uint16_t color_lut[LUT_SIZE] = {");
+    for (uint32_t cell = 0; cell < LUT_SIZE; cell++) {
+        uint32_t r = (cell >> 10) & 0x1F, g = (cell >> 5) & 0x1F, b = cell & 0x1F;
+        rgb_t base = (r << 19) | (g << 11) | (b << 3);
+
+        uint16_t entries[CELL_COLORS];
+        classify_cell(base, entries);
+        uint16_t entry = entries[0] | LUT_UNIFORM;
+        for (uint32_t i = 1; i < CELL_COLORS && (entry & LUT_UNIFORM); i++) {
+            if (entries[i] != entries[0]) entry &= ~LUT_UNIFORM;
+        }
+
+        float hue = rgb_to_hsv(base + 0x040404).h;
+        int q = (int)(hue * 256.0f);
+        if (q > 255) q = 255;
+        entry |= q << LUT_HUE_SHIFT;
+
+        fprintf(out, "%s0x%04x,", (cell % 8) ? " " : "\n    ", entry);
+    }
+    fprintf(out, "\n};\n");
+
+    return fclose(out) == 0 ? 0 : 1;
+}